@@ -1,11 +1,50 @@
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 #include <memory>
+#include <algorithm>
+#include <memory_resource>
+
+#include "arena.hpp"
+#include "highlight.hpp"
 
 // -------------------------------------- \\ 
 // ------------- TEMPLATES -------------- \\ 
 // -------------------------------------- \\ 
 
+/*
+	@return str with quotes, backslashes and control characters escaped for use in a JSON string
+*/
+inline std::string jsonEscape(std::string_view str) {
+	static const char hex[] = "0123456789abcdef";
+	std::string res;
+	res.reserve(str.size());
+
+	// Copy runs that need no escaping in one go
+	size_t run = 0;
+	for (size_t i = 0; i < str.size(); i++) {
+		unsigned char c = str[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		res.append(str, run, i - run);
+		run = i + 1;
+		switch (c) {
+		case '"': res += "\\\""; break;
+		case '\\': res += "\\\\"; break;
+		case '\n': res += "\\n"; break;
+		case '\t': res += "\\t"; break;
+		case '\r': res += "\\r"; break;
+		default:
+			res += "\\u00";
+			res += hex[c >> 4];
+			res += hex[c & 15];
+		}
+	}
+	res.append(str, run, std::string::npos);
+	return res;
+}
+
 /*
 	Base Class for entire AST.
 	Introduces:
@@ -19,8 +58,32 @@ protected:
 
 	virtual std::string className() {return "_ASTElement";}
 
+	// In front of every node, holds the Arena it came from or nullptr for the heap
+	static const size_t nodeHeader = alignof(std::max_align_t);
+
 public:
 
+	/*
+		Nodes come from the active Arena of the thread (see Arena::Scope), from the heap if there is none.
+		Deleting a node of an Arena hands its memory back to that Arena for reuse, which therefore
+		has to outlive the node
+	*/
+	static void * operator new(size_t size) {
+		Arena * arena = Arena::current();
+		void * p = arena != nullptr ? arena->allocate(size + nodeHeader, nodeHeader) : ::operator new(size + nodeHeader);
+		*(Arena **) p = arena;
+		return (char *) p + nodeHeader;
+	}
+
+	static void operator delete(void * p, size_t size) {
+		void * start = (char *) p - nodeHeader;
+		Arena * arena = *(Arena **) start;
+		if (arena == nullptr)
+			::operator delete(start);
+		else
+			arena->deallocate(start, size + nodeHeader, nodeHeader);
+	}
+
 	virtual ~_ASTElement() {}
 
 	virtual std::string toString(std::string prefix) {
@@ -39,12 +102,15 @@ template<class cl>
 class _ASTListElement : virtual public _ASTElement {
 protected:
 
-	std::vector<std::unique_ptr<cl>> elements;
+	// Taken from the Arena active on construction, see Arena::resource()
+	std::pmr::vector<std::unique_ptr<cl>> elements;
 
 	std::string className() {return "_ASTListElement";}
 
 public:
 
+	_ASTListElement(std::pmr::memory_resource * resource = Arena::resource()) : elements(resource) {}
+
 	virtual void addElement(std::unique_ptr<cl> & element) {
 		if (element != nullptr)
 			elements.push_back(std::move(element));
@@ -84,6 +150,21 @@ public:
 		return elements.back();
 	}
 
+	virtual std::unique_ptr<cl> & at(size_t index) {
+		return elements[index];
+	}
+
+	/*
+		Removes every element from index first onwards
+		@return The removed elements, in order
+	*/
+	virtual std::vector<std::unique_ptr<cl>> takeElements(size_t first) {
+		std::vector<std::unique_ptr<cl>> res(
+			std::make_move_iterator(elements.begin() + first), std::make_move_iterator(elements.end()));
+		elements.erase(elements.begin() + first, elements.end());
+		return res;
+	}
+
 	std::string toJson() override {
 		std::string obj = "{\"class\": \"" + className() + "\",";
 		obj += "\"elements\": [";
@@ -120,6 +201,14 @@ public:
 		return "";
 	}
 
+	/*
+		Removes trailing spaces
+		@return Whether nothing is left of the element
+	*/
+	virtual bool trimRight() {
+		return false;
+	}
+
 };
 
 /*
@@ -139,6 +228,12 @@ public:
 		return res;
 	}
 
+	bool trimRight() override {
+		while (!elements.empty() && elements.back()->trimRight())
+			elements.pop_back();
+		return elements.empty();
+	}
+
 	std::string toJson() override {
 		return _ASTListElement<_ASTInlineElement>::toJson();
 	}
@@ -150,32 +245,37 @@ public:
 class ASTPlainText : public _ASTInlineElement {
 protected:
 
-	std::string content;
+	std::pmr::string content;
 
 	std::string className() {return "ASTPlainText";}
 
 public:
 
-	ASTPlainText(const std::string & content) : content(content) {}
+	ASTPlainText(const std::string & content) : content(content.data(), content.size(), Arena::resource()) {}
 
-	ASTPlainText(int chr) : content(1, chr) {}
+	ASTPlainText(int chr) : content(1, chr, Arena::resource()) {}
 
-	ASTPlainText(int count, int chr) : content(count, chr) {}
+	ASTPlainText(int count, int chr) : content(count, chr, Arena::resource()) {}
 
 	std::string literalText() override {
-		return content;
+		return std::string(content);
+	}
+
+	bool trimRight() override {
+		content.erase(content.find_last_not_of(' ') + 1);
+		return content.empty();
 	}
 
 	std::string toString(std::string prefix) {
 		return prefix + className() + "\n" + 
-			prefix + "  -content: \"" + content + "\"";
+			prefix + "  -content: \"" + std::string(content) + "\"";
 	}
 
 	std::string toJson() {
 		std::string obj = "{\"class\": \"" + className() + "\",";
 		obj += "\"content\": \"";
 
-		obj += content;
+		obj += jsonEscape(content);
 
 		obj += "\"}";
 		return obj;
@@ -215,6 +315,10 @@ public:
 	ASTTextModification(char symbol, std::unique_ptr<_ASTInlineElement> element) 
 	: symbol(symbol), content(std::move(element)) {}
 
+	_ASTInlineElement * getContent() {
+		return content.get();
+	}
+
 	std::string literalText() override {
 		return content->literalText();
 	}
@@ -241,24 +345,34 @@ public:
 };
 
 /*
-	Represents an inline emoji. Contains shortcode and converts it via conversion table
+	Represents an inline emoji, only known shortcodes become one (see emoji.hpp)
 */
 class ASTEmoji : public _ASTInlineElement {
 protected:
 
-	std::string shortcode;
+	// Both view into the static emoji table
+	std::string_view shortcode;
+	std::string_view utf8;
 
 	std::string className() {return "ASTEmoji";}
 
 public:
 
-	ASTEmoji(const std::string & shortcode) : shortcode(shortcode) {}
+	ASTEmoji(std::string_view shortcode, std::string_view utf8) : shortcode(shortcode), utf8(utf8) {}
+
+	std::string literalText() override {
+		return std::string(utf8);
+	}
 
 	std::string toJson() {
 		std::string obj = "{\"class\": \"" + className() + "\",";
 		obj += "\"shortcode\": \"";
 
-		obj += shortcode;
+		obj += jsonEscape(shortcode);
+
+		obj += "\",\"utf8\": \"";
+
+		obj += jsonEscape(utf8);
 
 		obj += "\"}";
 		return obj;
@@ -266,13 +380,267 @@ public:
 
 };
 
+/*
+	Command of an ASTModifier like {#id .class.other :"title" +attr=val $func args >style:val},
+	decoded once by Parser::parseCommand(). Class, function and style names are interned by the Parser,
+	keep it alive as long as the document
+*/
+struct ModifierCommand {
+	std::string id;
+	std::vector<std::string_view> classes;
+	std::string title;
+	std::vector<std::pair<std::string, std::string>> attributes;
+	std::string_view function;
+	std::vector<std::string> args;
+	std::vector<std::pair<std::string_view, std::string>> styles;
+
+	// Name of a %name word, the command then refers to a definition. Not part of empty() or the JSON
+	std::string reference;
+
+	bool empty() const {
+		return id.empty() && classes.empty() && title.empty() && attributes.empty() &&
+			function.empty() && styles.empty();
+	}
+
+	// Only parts that are set are written
+	std::string toJson() const {
+		std::string obj = "{";
+
+		if (!id.empty())
+			obj += "\"id\": \"" + jsonEscape(id) + "\",";
+
+		if (!classes.empty()) {
+			obj += "\"classes\": [";
+			for (auto & c : classes)
+				obj += "\"" + jsonEscape(c) + "\",";
+			obj.back() = ']';
+			obj += ",";
+		}
+
+		if (!title.empty())
+			obj += "\"title\": \"" + jsonEscape(title) + "\",";
+
+		if (!attributes.empty()) {
+			obj += "\"attributes\": {";
+			for (auto & a : attributes)
+				obj += "\"" + jsonEscape(a.first) + "\": \"" + jsonEscape(a.second) + "\",";
+			obj.back() = '}';
+			obj += ",";
+		}
+
+		if (!function.empty()) {
+			obj += "\"function\": \"" + jsonEscape(function) + "\",";
+			obj += "\"args\": [";
+			for (auto & a : args)
+				obj += "\"" + jsonEscape(a) + "\",";
+			if (!args.empty())
+				obj.pop_back();
+			obj += "],";
+		}
+
+		if (!styles.empty()) {
+			// Kept as a list, a style can be set more than once
+			obj += "\"styles\": [";
+			for (auto & st : styles)
+				obj += "[\"" + jsonEscape(st.first) + "\", \"" + jsonEscape(st.second) + "\"],";
+			obj.back() = ']';
+			obj += ",";
+		}
+
+		if (obj.size() > 1)
+			obj.pop_back();
+		obj += "}";
+		return obj;
+	}
+};
+
+/*
+	Target of a %name or ^id reference. Uses point to it as soon as they are parsed and a definition
+	later in the file fills it in, so nothing has to be resolved after parsing
+*/
+struct Reference {
+	char kind; // '%', '^' for footnotes or '#' for headings
+	std::string name;
+	bool defined = false;
+
+	std::string url; // %(name): url command
+	ModifierCommand command; // %(name) and %{name}: command
+	std::unique_ptr<ASTInlineText> content; // %<name>: text and ^id: text
+
+	int number = 0; // Footnotes only, in order of first use starting at 1
+};
+
+/*
+	References of a document by kind and name, names as Parser::make_id() returns them
+*/
+class ReferenceTable {
+protected:
+
+	// Elements never move, so uses can keep pointers to them
+	std::unordered_map<std::string, Reference> refs;
+
+	std::vector<Reference *> footnotes;
+
+public:
+
+	/*
+		@return Reference of that kind and name. Created undefined if it was neither used nor defined yet
+	*/
+	Reference * get(char kind, const std::string & name) {
+		auto res = refs.try_emplace(std::string(1, kind) + name);
+		Reference & ref = res.first->second;
+		if (res.second) {
+			ref.kind = kind;
+			ref.name = name;
+		}
+		return &ref;
+	}
+
+	/*
+		@return The footnote id, numbered if this is its first use
+	*/
+	Reference * useFootnote(const std::string & id) {
+		Reference * ref = get('^', id);
+		if (ref->number == 0) {
+			footnotes.push_back(ref);
+			ref->number = footnotes.size();
+		}
+		return ref;
+	}
+
+	// Footnotes used so far, in order of their number
+	const std::vector<Reference *> & usedFootnotes() const {
+		return footnotes;
+	}
+
+	std::string toJson() {
+		std::string obj = "[";
+		for (Reference * ref : footnotes) {
+			obj += "{\"number\": " + std::to_string(ref->number) + ",";
+			obj += "\"id\": \"" + jsonEscape(ref->name) + "\",";
+			obj += "\"defined\": " + std::to_string(ref->defined) + ",";
+			obj += "\"text\": ";
+			obj += ref->content != nullptr ? ref->content->toJson() : "{\"class\": \"ASTInlineText\",\"elements\": []}";
+			obj += "},";
+		}
+		if (!footnotes.empty())
+			obj.pop_back();
+		obj += "]";
+		return obj;
+	}
+};
+
+class ASTHeading;
+
+/*
+	Headings of a document by id, ids made unique as headings are added
+*/
+class AnchorIndex {
+protected:
+
+	std::unordered_map<std::string, ASTHeading *> headings;
+
+	// Next suffix to try for an id that was taken
+	std::unordered_map<std::string, int> suffixes;
+
+public:
+
+	/*
+		@param id Id as Parser::make_id() returns it, must not be empty
+		@return id, with "-1", "-2" and so on appended if another heading has it already
+	*/
+	std::string add(std::string id, ASTHeading * heading) {
+		if (headings.emplace(id, heading).second)
+			return id;
+
+		// Ids of other headings may end in a number as well, try until one is free
+		int & next = suffixes[id];
+		std::string res;
+		do {
+			res = id + "-" + std::to_string(++next);
+		} while (!headings.emplace(res, heading).second);
+		return res;
+	}
+
+	/*
+		@return Heading with that id, nullptr if there is none (yet)
+	*/
+	ASTHeading * find(const std::string & id) const {
+		auto it = headings.find(id);
+		return it != headings.end() ? it->second : nullptr;
+	}
+};
+
+/*
+	Headings of a document in order, collected while they are parsed
+*/
+class TableOfContents {
+public:
+
+	struct Entry {
+		int level;
+		std::string id;
+		std::string text;
+	};
+
+protected:
+
+	std::vector<Entry> entries;
+
+public:
+
+	void add(int level, std::string id, std::string text) {
+		entries.push_back({ level, std::move(id), std::move(text) });
+	}
+
+	const std::vector<Entry> & getEntries() const {
+		return entries;
+	}
+
+	std::string toJson() {
+		std::string obj = "[";
+		for (auto & e : entries) {
+			obj += "{\"level\": " + std::to_string(e.level) + ",";
+			obj += "\"id\": \"" + jsonEscape(e.id) + "\",";
+			obj += "\"text\": \"" + jsonEscape(e.text) + "\"},";
+		}
+		if (!entries.empty())
+			obj.pop_back();
+		obj += "]";
+		return obj;
+	}
+};
+
+/*
+	Inserted by []{$insert_toc}. Points to the table of the document, which has every heading
+	once parsing is done, so it is written in the same pass as everything else
+*/
+class ASTTableOfContents : public _ASTInlineElement {
+protected:
+
+	TableOfContents * toc;
+
+	std::string className() {return "ASTTableOfContents";}
+
+public:
+
+	ASTTableOfContents(TableOfContents * toc) : toc(toc) {}
+
+	std::string toJson() {
+		std::string obj = "{\"class\": \"" + className() + "\",";
+		obj += "\"entries\": " + toc->toJson();
+		obj += "}";
+		return obj;
+	}
+};
+
 /*
 	Represents everything that is enclosed in square brackets
 */
 class ASTModifier : public _ASTInlineElement {
 protected:
 
-	std::string command;
+	ModifierCommand command;
 
 	std::string url;
 
@@ -280,28 +648,64 @@ protected:
 	
 	std::unique_ptr<ASTInlineText> content;
 
+	// Definition url, command or content refer to, nullptr if none
+	Reference * reference = nullptr;
+
 	std::string className() {return "ASTModifier";}
 
 public:
 
-	ASTModifier(int type, std::string url, std::string command, std::unique_ptr<ASTInlineText> content)
-		: type(type), url(url), command(command), content(std::move(content)) {}
+	ASTModifier(int type, std::string url, ModifierCommand command, std::unique_ptr<ASTInlineText> content)
+		: type(type), url(url), command(std::move(command)), content(std::move(content)) {}
 
 	std::string literalText() override {
 		return content->literalText();
 	}
 
+	ASTInlineText * getContent() {
+		return content.get();
+	}
+
+	const ModifierCommand & getCommand() const {
+		return command;
+	}
+
+	void setReference(Reference * reference) {
+		this->reference = reference;
+	}
+
+	Reference * getReference() const {
+		return reference;
+	}
+
+	/*
+		Parts of the definition replace those that are not given here. Content is only replaced
+		for <%name>, the own one is shown if the name is not defined
+	*/
 	std::string toJson() {
+		bool defined = reference != nullptr && reference->defined;
+
 		std::string obj = "{\"class\": \"" + className() + "\",";
 		obj += "\"type\": \"";
 		obj += type;
 		obj += "\",";
 
-		obj += "\"url\": \"" + url + "\",";
-		obj += "\"command\": \"" + command + "\",";
+		obj += "\"url\": \"" + jsonEscape(defined && !reference->url.empty() ? reference->url : url) + "\",";
+		obj += "\"command\": " + (defined && command.empty() ? reference->command : command).toJson() + ",";
+
+		if (reference != nullptr) {
+			obj += "\"reference\": {\"name\": \"" + jsonEscape(reference->name) + "\",";
+			obj += "\"defined\": " + std::to_string(defined);
+			if (reference->number != 0)
+				obj += ",\"number\": " + std::to_string(reference->number);
+			obj += "},";
+		}
 
 		obj += "\"content\":";
-		obj += content->toJson();
+		if (defined && type == '<' && reference->content != nullptr)
+			obj += reference->content->toJson();
+		else
+			obj += content->toJson();
 
 		obj += "}";
 		return obj;
@@ -321,15 +725,68 @@ public:
 typedef _ASTListElement<_ASTElement> _ASTBlockElement;
 
 /*
-	Holds all elements of a file
+	Owner of the Arena of an ASTDocument. As a base in front of _ASTBlockElement it is
+	destroyed last, after every node that was allocated from the Arena
 */
-class ASTDocument : public _ASTBlockElement {
+class _ASTArenaOwner {
 protected:
 
+	std::unique_ptr<Arena> _arena;
+
+	_ASTArenaOwner(bool hugePages) : _arena(std::make_unique<Arena>(hugePages)) {}
+};
+
+/*
+	Holds all elements of a file. Parser::parseDocument() allocates every node and child list
+	from the Arena of the document, they are all released at once with it
+*/
+class ASTDocument : protected _ASTArenaOwner, public _ASTBlockElement {
+protected:
+
+	ReferenceTable refs;
+
+	TableOfContents headings;
+
+	AnchorIndex anchorIndex;
+
 	std::string className() {return "ASTDocument";}
 
 public:
 
+	/*
+		@param hugePages Whether the Arena takes its memory in huge pages, see Arena()
+	*/
+	ASTDocument(bool hugePages = false) : _ASTArenaOwner(hugePages), _ASTBlockElement(_arena.get()) {}
+
+	/*
+		@return Arena holding the nodes of this document. Activate it with an Arena::Scope to add nodes
+		created elsewhere, they must not outlive the document then
+	*/
+	Arena & arena() {
+		return *_arena;
+	}
+
+	AnchorIndex & anchors() {
+		return anchorIndex;
+	}
+
+	ReferenceTable & references() {
+		return refs;
+	}
+
+	TableOfContents & toc() {
+		return headings;
+	}
+
+	std::string toJson() override {
+		std::string obj = _ASTBlockElement::toJson();
+		if (refs.usedFootnotes().empty())
+			return obj;
+
+		obj.pop_back();
+		obj += ",\"footnotes\": " + refs.toJson() + "}";
+		return obj;
+	}
 };
 
 /*
@@ -340,17 +797,35 @@ protected:
 
 	int level = 0;
 
+	// Unique in the document, empty for empty headings
+	std::string id;
+
 	std::unique_ptr<ASTInlineText> content;
 
 	std::string className() override {return "ASTHeading";}
 
 public:
 
-	ASTHeading(int level, std::unique_ptr<ASTInlineText> content) : level(level), content(std::move(content)) {}
+	// Empty headings have no content
+	ASTHeading(int level, std::unique_ptr<ASTInlineText> content) : level(level),
+		content(content != nullptr ? std::move(content) : std::make_unique<ASTInlineText>()) {}
+
+	ASTInlineText * getContent() {
+		return content.get();
+	}
+
+	const std::string & getId() const {
+		return id;
+	}
+
+	void setId(std::string id) {
+		this->id = std::move(id);
+	}
 
 	std::string toJson() {
 		std::string obj = "{\"class\": \"" + className() + "\",";
 		obj += "\"level\": " + std::to_string(level) + ",";
+		obj += "\"id\": \"" + jsonEscape(id) + "\",";
 		obj += "\"text\": ";
 
 		obj += content->toJson();
@@ -473,7 +948,7 @@ public:
 };
 
 /*
-	Holds code text
+	Holds code text as one span, lines are only split up for output
 */
 class ASTCodeBlock : public _ASTBlockElement {
 protected:
@@ -482,19 +957,166 @@ protected:
 
 	std::unique_ptr<ASTInlineText> command;
 
+	// Text between the fences, lines separated by '\n'. Either a view into the input or into ownBody
+	std::string_view body;
+	std::string ownBody;
+
+	// Spans of body from HighlightCache::shared(), looked up on the first call of highlighting()
+	std::shared_ptr<const Highlight> highlight;
+	bool highlighted = false;
+
 	std::string className() {return "ASTCodeBlock";}
 
 public:
 
-	ASTCodeBlock(std::string lang) : lang(lang) {}
+	/*
+		@param body Refers into the input, which has to outlive this
+	*/
+	ASTCodeBlock(std::string lang, std::string_view body) : lang(lang), body(body) {}
+
+	ASTCodeBlock(std::string lang, std::string && body) : lang(lang), ownBody(std::move(body)) {
+		this->body = ownBody;
+	}
 
 	void addCommand(std::unique_ptr<ASTInlineText> & e) {
 		command = std::move(e);
 	}
 
+	std::string_view text() const {
+		return body;
+	}
+
+	/*
+		@return Syntax highlighting of text(), nullptr if lang is no language highlightCode() knows.
+		Code repeated in other blocks or documents is only tokenized once
+	*/
+	const Highlight * highlighting() {
+		if (!highlighted) {
+			highlight = HighlightCache::shared().get(lang, body);
+			highlighted = true;
+		}
+		return highlight.get();
+	}
+
 	std::string toJson() override {
 		std::string obj = "{\"class\": \"" + className() + "\",";
-		obj += "\"lang\": \"" + lang + "\",";
+		obj += "\"lang\": \"" + jsonEscape(lang) + "\",";
+		if (highlighting())
+			obj += "\"highlight\": " + highlight->toJson() + ",";
+		obj += "\"elements\": [";
+
+		// Same as one ASTPlainText per line
+		size_t start = 0;
+		while (true) {
+			size_t end = std::min(body.find('\n', start), body.size());
+			obj += "{\"class\": \"ASTPlainText\",\"content\": \"";
+			obj += jsonEscape(body.substr(start, end - start));
+			obj += "\"},";
+			if (end == body.size())
+				break;
+			start = end + 1;
+		}
+
+		for (auto & e : elements) {
+			obj += e->toJson() + ",";
+		}
+
+		obj.erase(std::prev(obj.end()));
+
+		obj += "]}";
+		return obj;
+	}
+
+};
+
+/*
+	Cell of an ASTTableRow. Cells without any markup keep their text as written,
+	only the others are parsed into content
+*/
+class ASTTableCell : public _ASTElement {
+protected:
+
+	// Either a view into the input or into ownText, unused if content is set
+	std::string_view text;
+	std::string ownText;
+
+	std::unique_ptr<ASTInlineText> content;
+
+	std::string className() {return "ASTTableCell";}
+
+public:
+
+	/*
+		@param text Refers into the input, which has to outlive this
+	*/
+	ASTTableCell(std::string_view text) : text(text) {}
+
+	ASTTableCell(std::string && text) : ownText(std::move(text)) {
+		this->text = ownText;
+	}
+
+	ASTTableCell(std::unique_ptr<ASTInlineText> content) : content(std::move(content)) {}
+
+	std::string toJson() override {
+		std::string obj = "{\"class\": \"" + className() + "\",";
+		obj += "\"text\": ";
+
+		// Same as an ASTInlineText holding one ASTPlainText
+		if (content != nullptr)
+			obj += content->toJson();
+		else if (text.empty())
+			obj += "{\"class\": \"ASTInlineText\",\"elements\": []}";
+		else {
+			obj += "{\"class\": \"ASTInlineText\",\"elements\": [{\"class\": \"ASTPlainText\",\"content\": \"";
+			obj += jsonEscape(text);
+			obj += "\"}]}";
+		}
+
+		obj += "}";
+		return obj;
+	}
+};
+
+/*
+	Row of an ASTTable
+*/
+class ASTTableRow : public _ASTListElement<ASTTableCell> {
+protected:
+
+	std::string className() {return "ASTTableRow";}
+
+public:
+
+};
+
+/*
+	Represents pipe tables. Alignment is one of 'l', 'c', 'r' or 0 ('-' in JSON) per column,
+	as far as an alignment row specified it
+*/
+class ASTTable : public _ASTListElement<ASTTableRow> {
+protected:
+
+	std::vector<char> alignment;
+
+	// Whether the first row is a header, only if it is followed by an alignment row
+	bool header = false;
+
+	std::string className() {return "ASTTable";}
+
+public:
+
+	void setAlignment(std::vector<char> && alignment) {
+		this->alignment = std::move(alignment);
+		header = true;
+	}
+
+	std::string toJson() override {
+		std::string obj = "{\"class\": \"" + className() + "\",";
+		obj += "\"header\": " + std::to_string(header) + ",";
+		obj += "\"alignment\": \"";
+		for (char a : alignment)
+			obj += a == 0 ? '-' : a;
+		obj += "\",";
 		obj += "\"elements\": [";
 
 		for (auto & e : elements) {
@@ -507,5 +1129,4 @@ public:
 		obj += "]}";
 		return obj;
 	}
-
 };
@@ -0,0 +1,97 @@
+#include "arena.hpp"
+
+#include <new>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ARENA_HAS_MMAP 1
+#include <sys/mman.h>
+#endif
+
+thread_local Arena::SpareChunks Arena::spare;
+
+Arena::SpareChunks::~SpareChunks() {
+	closed = true;
+	while (first != nullptr) {
+		Chunk * next = first->next;
+		release(first);
+		first = next;
+	}
+	bytes = 0;
+}
+
+void Arena::release(Chunk * chunk) {
+#ifdef ARENA_HAS_MMAP
+	if (chunk->mapped) {
+		munmap(chunk, chunk->size);
+		return;
+	}
+#endif
+	::operator delete(chunk);
+}
+
+Arena::Chunk * Arena::takeSpare(size_t size) {
+	// Smallest one that fits, only mapped ones can stand in for huge pages
+	Chunk ** best = nullptr;
+	for (Chunk ** e = &spare.first; *e != nullptr; e = &(*e)->next) {
+		if ((*e)->size >= size && (!hugePages || (*e)->mapped) && (best == nullptr || (*e)->size < (*best)->size))
+			best = e;
+	}
+	if (best == nullptr)
+		return nullptr;
+
+	Chunk * chunk = *best;
+	*best = chunk->next;
+	spare.bytes -= chunk->size;
+	return chunk;
+}
+
+void Arena::grow(size_t size, size_t align) {
+	// Enough for the worst case of aligning the start
+	size_t chunkSize = std::max(nextSize, sizeof(Chunk) + align + size);
+	if (nextSize < maxChunk)
+		nextSize *= 2;
+
+	Chunk * chunk = takeSpare(chunkSize);
+	if (chunk != nullptr)
+		chunkSize = chunk->size;
+#ifdef ARENA_HAS_MMAP
+	if (chunk == nullptr && hugePages) {
+		chunkSize = (chunkSize + hugePageSize - 1) & ~(hugePageSize - 1);
+		void * map = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+			madvise(map, chunkSize, MADV_HUGEPAGE);
+#endif
+			chunk = (Chunk *) map;
+			chunk->mapped = true;
+		}
+	}
+#endif
+	if (chunk == nullptr) {
+		chunk = (Chunk *) ::operator new(chunkSize);
+		chunk->mapped = false;
+	}
+
+	chunk->size = chunkSize;
+	chunk->next = chunks;
+	chunks = chunk;
+	_reserved += chunkSize;
+
+	cur = (char *) chunk + sizeof(Chunk);
+	end = (char *) chunk + chunkSize;
+}
+
+Arena::~Arena() {
+	while (chunks != nullptr) {
+		Chunk * next = chunks->next;
+		if (!spare.closed && spare.bytes + chunks->size <= maxSpare) {
+			chunks->next = spare.first;
+			spare.first = chunks;
+			spare.bytes += chunks->size;
+		}
+		else
+			release(chunks);
+		chunks = next;
+	}
+}
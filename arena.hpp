@@ -0,0 +1,160 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+
+/*
+	Allocator for everything of one document. Memory is handed out from large chunks that are only
+	given back all at once when the Arena is destroyed. Freed small blocks are kept for reuse by the
+	next allocation of the same size class, so child lists that grow and nodes dropped while parsing
+	do not leave dead memory behind. Chunks of a destroyed Arena are kept by the thread for its next
+	one, up to maxSpare bytes, so documents parsed one after another reuse memory that is already paged in.
+	Allocations of _ASTElement and the containers of the AST go to the active Arena of the thread (see Scope)
+*/
+class Arena : public std::pmr::memory_resource {
+protected:
+
+	struct Chunk {
+		Chunk * next;
+		size_t size; // Including this header
+		bool mapped; // From mmap instead of operator new
+	};
+
+	Chunk * chunks = nullptr;
+
+	struct FreeBlock {
+		FreeBlock * next;
+	};
+
+	// Blocks up to maxPooled bytes are rounded up to a multiple of poolGranule,
+	// pool[i] holds the freed ones of (i + 1) * poolGranule bytes
+	static const size_t poolGranule = 16;
+	static const size_t maxPooled = 256;
+	FreeBlock * pool[maxPooled / poolGranule] = {};
+
+	// Free part of the newest chunk
+	char * cur = nullptr;
+	char * end = nullptr;
+
+	size_t nextSize = firstChunk;
+	bool hugePages;
+	size_t _reserved = 0;
+
+	static inline thread_local Arena * active = nullptr;
+
+	// Chunks of destroyed Arenas of the thread, given back to the system when it ends
+	struct SpareChunks {
+		Chunk * first = nullptr;
+		size_t bytes = 0;
+		bool closed = false; // Thread is ending, Arenas destroyed later release their chunks
+
+		~SpareChunks();
+	};
+
+	static thread_local SpareChunks spare;
+
+	// Gives a chunk back to the system
+	static void release(Chunk * chunk);
+
+	// Removes a spare chunk of at least size bytes from the thread's list, nullptr if there is none
+	Chunk * takeSpare(size_t size);
+
+	// Adds a chunk with room for size bytes aligned to align
+	void grow(size_t size, size_t align);
+
+	void * do_allocate(size_t size, size_t align) override {
+		if (size - 1 < maxPooled && align <= poolGranule) {
+			FreeBlock *& free = pool[(size - 1) / poolGranule];
+			if (free != nullptr) {
+				FreeBlock * block = free;
+				free = block->next;
+				return block;
+			}
+			size = ((size - 1) / poolGranule + 1) * poolGranule;
+			align = poolGranule;
+		}
+
+		char * res = (char *) (((size_t) cur + align - 1) & ~(align - 1));
+		if (cur == nullptr || (size_t) (end - cur) < (size_t) (res - cur) + size) {
+			grow(size, align);
+			res = (char *) (((size_t) cur + align - 1) & ~(align - 1));
+		}
+		cur = res + size;
+		return res;
+	}
+
+	void do_deallocate(void * p, size_t size, size_t align) override {
+		if (size - 1 < maxPooled && align <= poolGranule) {
+			FreeBlock *& free = pool[(size - 1) / poolGranule];
+			FreeBlock * block = (FreeBlock *) p;
+			block->next = free;
+			free = block;
+		}
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override {
+		return this == &other;
+	}
+
+public:
+
+	// Chunks start at firstChunk and double up to maxChunk, larger allocations get a chunk of their own
+	static const size_t firstChunk = 64 * 1024;
+	static const size_t maxChunk = 4 * 1024 * 1024;
+	static const size_t hugePageSize = 2 * 1024 * 1024;
+	// Most bytes of chunks a thread keeps for its next Arena
+	static const size_t maxSpare = 64 * 1024 * 1024;
+
+	/*
+		@param hugePages Take chunks in multiples of hugePageSize and ask the system to back them
+		by huge pages, fewer TLB misses on large documents. Ignored where there are none
+	*/
+	Arena(bool hugePages = false) : hugePages(hugePages) {}
+
+	Arena(const Arena &) = delete;
+	Arena & operator=(const Arena &) = delete;
+
+	~Arena();
+
+	/*
+		@return Bytes of all chunks of this Arena
+	*/
+	size_t reserved() const {
+		return _reserved;
+	}
+
+	/*
+		@return Arena of the innermost Scope of this thread, nullptr if there is none
+	*/
+	static Arena * current() {
+		return active;
+	}
+
+	/*
+		@return current(), or the default heap if there is no Arena. For containers of AST nodes
+	*/
+	static std::pmr::memory_resource * resource() {
+		return active != nullptr ? active : std::pmr::new_delete_resource();
+	}
+
+	/*
+		Makes arena the active one of the thread until the Scope ends. Scopes nest
+	*/
+	class Scope {
+	protected:
+
+		Arena * previous;
+
+	public:
+
+		Scope(Arena & arena) : previous(active) {
+			active = &arena;
+		}
+
+		Scope(const Scope &) = delete;
+		Scope & operator=(const Scope &) = delete;
+
+		~Scope() {
+			active = previous;
+		}
+	};
+};
@@ -0,0 +1,88 @@
+/*
+	Compares runtime handler dispatch (Parser + addDefaultHandlers()) with compile-time
+	dispatch (DefaultParser) on the same input. Both parse from memory, so only parsing is timed.
+
+	Build from the repository root:
+	  g++ -std=c++17 -O2 -I. bench/dispatch.cpp lexer.cpp handlers.cpp source.cpp scanner.cpp token.cpp utf8.cpp lines.cpp emoji.cpp highlight.cpp arena.cpp -o dispatch
+	Run:
+	  ./dispatch <file.nd> [rounds]
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#include "static_parser.hpp"
+
+/*
+	@return Milliseconds to create a parser with make and parse the whole input
+*/
+template<class MakeParser>
+double parseOnce(MakeParser make) {
+	auto start = std::chrono::steady_clock::now();
+	auto parser = make();
+	parser->parseDocument();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+	@return JSON of the document parsed by a parser from make, not timed
+*/
+template<class MakeParser>
+std::string parseToJson(MakeParser make) {
+	auto parser = make();
+	parser->parseDocument();
+	return parser->getDocument()->toJson();
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <file.nd> [rounds]" << std::endl;
+		return 1;
+	}
+	int rounds = argc > 2 ? std::stoi(argv[2]) : 10;
+
+	std::ifstream file(argv[1], std::ios::binary);
+	if (!file) {
+		std::cerr << "cannot open " << argv[1] << std::endl;
+		return 1;
+	}
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	std::string input = buffer.str();
+
+	auto makeRuntime = [&]() {
+		auto parser = std::make_unique<Parser>(input.data(), input.size());
+		parser->addDefaultHandlers();
+		return parser;
+	};
+	auto makeStatic = [&]() {
+		return std::make_unique<DefaultParser>(input.data(), input.size());
+	};
+
+	// Rounds alternate which one goes first, whatever runs second sees the heap left behind by the other
+	double runtimeMs = 0, staticMs = 0;
+	for (int i = 0; i < rounds; i++) {
+		double runtime, fixed;
+		if (i % 2 == 0) {
+			runtime = parseOnce(makeRuntime);
+			fixed = parseOnce(makeStatic);
+		}
+		else {
+			fixed = parseOnce(makeStatic);
+			runtime = parseOnce(makeRuntime);
+		}
+		if (i == 0 || runtime < runtimeMs)
+			runtimeMs = runtime;
+		if (i == 0 || fixed < staticMs)
+			staticMs = fixed;
+	}
+
+	bool identical = parseToJson(makeRuntime) == parseToJson(makeStatic);
+
+	std::cout << "input    " << input.size() << " bytes, best of " << rounds << std::endl;
+	std::cout << "runtime  " << runtimeMs << " ms" << std::endl;
+	std::cout << "static   " << staticMs << " ms" << std::endl;
+	std::cout << "output   " << (identical ? "identical" : "DIFFERENT") << std::endl;
+	return identical ? 0 : 2;
+}
@@ -0,0 +1,387 @@
+#include "emoji.hpp"
+
+#include <cstdint>
+#include <algorithm>
+
+// Shortcodes as on GitHub, which most writers know already
+static constexpr Emoji emojis[] = {
+	{ "smile", "😄" },
+	{ "smiley", "😃" },
+	{ "grinning", "😀" },
+	{ "grin", "😁" },
+	{ "laughing", "😆" },
+	{ "satisfied", "😆" },
+	{ "sweat_smile", "😅" },
+	{ "joy", "😂" },
+	{ "rofl", "🤣" },
+	{ "relaxed", "☺️" },
+	{ "blush", "😊" },
+	{ "innocent", "😇" },
+	{ "slightly_smiling_face", "🙂" },
+	{ "upside_down_face", "🙃" },
+	{ "wink", "😉" },
+	{ "relieved", "😌" },
+	{ "heart_eyes", "😍" },
+	{ "kissing_heart", "😘" },
+	{ "kissing", "😗" },
+	{ "yum", "😋" },
+	{ "stuck_out_tongue", "😛" },
+	{ "stuck_out_tongue_winking_eye", "😜" },
+	{ "stuck_out_tongue_closed_eyes", "😝" },
+	{ "money_mouth_face", "🤑" },
+	{ "hugs", "🤗" },
+	{ "thinking", "🤔" },
+	{ "zipper_mouth_face", "🤐" },
+	{ "neutral_face", "😐" },
+	{ "expressionless", "😑" },
+	{ "no_mouth", "😶" },
+	{ "smirk", "😏" },
+	{ "unamused", "😒" },
+	{ "roll_eyes", "🙄" },
+	{ "grimacing", "😬" },
+	{ "lying_face", "🤥" },
+	{ "pensive", "😔" },
+	{ "sleepy", "😪" },
+	{ "sleeping", "😴" },
+	{ "mask", "😷" },
+	{ "nerd_face", "🤓" },
+	{ "sunglasses", "😎" },
+	{ "confused", "😕" },
+	{ "worried", "😟" },
+	{ "slightly_frowning_face", "🙁" },
+	{ "open_mouth", "😮" },
+	{ "hushed", "😯" },
+	{ "astonished", "😲" },
+	{ "flushed", "😳" },
+	{ "frowning", "😦" },
+	{ "anguished", "😧" },
+	{ "fearful", "😨" },
+	{ "cold_sweat", "😰" },
+	{ "disappointed_relieved", "😥" },
+	{ "cry", "😢" },
+	{ "sob", "😭" },
+	{ "scream", "😱" },
+	{ "confounded", "😖" },
+	{ "persevere", "😣" },
+	{ "disappointed", "😞" },
+	{ "sweat", "😓" },
+	{ "weary", "😩" },
+	{ "tired_face", "😫" },
+	{ "triumph", "😤" },
+	{ "rage", "😡" },
+	{ "angry", "😠" },
+	{ "smiling_imp", "😈" },
+	{ "imp", "👿" },
+	{ "skull", "💀" },
+	{ "poop", "💩" },
+	{ "clown_face", "🤡" },
+	{ "ghost", "👻" },
+	{ "alien", "👽" },
+	{ "robot", "🤖" },
+	{ "smiley_cat", "😺" },
+	{ "heart", "❤️" },
+	{ "broken_heart", "💔" },
+	{ "sparkling_heart", "💖" },
+	{ "yellow_heart", "💛" },
+	{ "green_heart", "💚" },
+	{ "blue_heart", "💙" },
+	{ "purple_heart", "💜" },
+	{ "100", "💯" },
+	{ "boom", "💥" },
+	{ "collision", "💥" },
+	{ "dizzy", "💫" },
+	{ "zzz", "💤" },
+	{ "wave", "👋" },
+	{ "raised_hand", "✋" },
+	{ "ok_hand", "👌" },
+	{ "v", "✌️" },
+	{ "crossed_fingers", "🤞" },
+	{ "point_left", "👈" },
+	{ "point_right", "👉" },
+	{ "point_up", "☝️" },
+	{ "point_down", "👇" },
+	{ "+1", "👍" },
+	{ "thumbsup", "👍" },
+	{ "-1", "👎" },
+	{ "thumbsdown", "👎" },
+	{ "fist", "✊" },
+	{ "punch", "👊" },
+	{ "clap", "👏" },
+	{ "raised_hands", "🙌" },
+	{ "open_hands", "👐" },
+	{ "pray", "🙏" },
+	{ "muscle", "💪" },
+	{ "eyes", "👀" },
+	{ "brain", "🧠" },
+	{ "baby", "👶" },
+	{ "man", "👨" },
+	{ "woman", "👩" },
+	{ "dog", "🐶" },
+	{ "cat", "🐱" },
+	{ "mouse", "🐭" },
+	{ "rabbit", "🐰" },
+	{ "fox_face", "🦊" },
+	{ "bear", "🐻" },
+	{ "panda_face", "🐼" },
+	{ "koala", "🐨" },
+	{ "tiger", "🐯" },
+	{ "lion", "🦁" },
+	{ "cow", "🐮" },
+	{ "pig", "🐷" },
+	{ "frog", "🐸" },
+	{ "monkey_face", "🐵" },
+	{ "see_no_evil", "🙈" },
+	{ "chicken", "🐔" },
+	{ "penguin", "🐧" },
+	{ "bird", "🐦" },
+	{ "bug", "🐛" },
+	{ "bee", "🐝" },
+	{ "snake", "🐍" },
+	{ "turtle", "🐢" },
+	{ "octopus", "🐙" },
+	{ "fish", "🐟" },
+	{ "whale", "🐳" },
+	{ "unicorn", "🦄" },
+	{ "cactus", "🌵" },
+	{ "evergreen_tree", "🌲" },
+	{ "deciduous_tree", "🌳" },
+	{ "seedling", "🌱" },
+	{ "herb", "🌿" },
+	{ "four_leaf_clover", "🍀" },
+	{ "fallen_leaf", "🍂" },
+	{ "rose", "🌹" },
+	{ "sunflower", "🌻" },
+	{ "sun_with_face", "🌞" },
+	{ "sunny", "☀️" },
+	{ "cloud", "☁️" },
+	{ "umbrella", "☔" },
+	{ "snowflake", "❄️" },
+	{ "zap", "⚡" },
+	{ "fire", "🔥" },
+	{ "droplet", "💧" },
+	{ "ocean", "🌊" },
+	{ "rainbow", "🌈" },
+	{ "star", "⭐" },
+	{ "star2", "🌟" },
+	{ "sparkles", "✨" },
+	{ "crescent_moon", "🌙" },
+	{ "earth_africa", "🌍" },
+	{ "apple", "🍎" },
+	{ "banana", "🍌" },
+	{ "cherries", "🍒" },
+	{ "pizza", "🍕" },
+	{ "hamburger", "🍔" },
+	{ "coffee", "☕" },
+	{ "tea", "🍵" },
+	{ "beer", "🍺" },
+	{ "cake", "🍰" },
+	{ "cookie", "🍪" },
+	{ "tada", "🎉" },
+	{ "gift", "🎁" },
+	{ "balloon", "🎈" },
+	{ "trophy", "🏆" },
+	{ "medal_sports", "🏅" },
+	{ "soccer", "⚽" },
+	{ "basketball", "🏀" },
+	{ "video_game", "🎮" },
+	{ "musical_note", "🎵" },
+	{ "art", "🎨" },
+	{ "car", "🚗" },
+	{ "bike", "🚲" },
+	{ "airplane", "✈️" },
+	{ "rocket", "🚀" },
+	{ "ship", "🚢" },
+	{ "house", "🏠" },
+	{ "hourglass", "⌛" },
+	{ "watch", "⌚" },
+	{ "alarm_clock", "⏰" },
+	{ "iphone", "📱" },
+	{ "computer", "💻" },
+	{ "keyboard", "⌨️" },
+	{ "bulb", "💡" },
+	{ "battery", "🔋" },
+	{ "electric_plug", "🔌" },
+	{ "wrench", "🔧" },
+	{ "hammer", "🔨" },
+	{ "gear", "⚙️" },
+	{ "lock", "🔒" },
+	{ "unlock", "🔓" },
+	{ "key", "🔑" },
+	{ "link", "🔗" },
+	{ "paperclip", "📎" },
+	{ "scissors", "✂️" },
+	{ "pencil2", "✏️" },
+	{ "memo", "📝" },
+	{ "book", "📖" },
+	{ "books", "📚" },
+	{ "bookmark", "🔖" },
+	{ "calendar", "📆" },
+	{ "chart_with_upwards_trend", "📈" },
+	{ "chart_with_downwards_trend", "📉" },
+	{ "clipboard", "📋" },
+	{ "pushpin", "📌" },
+	{ "mag", "🔍" },
+	{ "package", "📦" },
+	{ "email", "📧" },
+	{ "envelope", "✉️" },
+	{ "bell", "🔔" },
+	{ "mega", "📣" },
+	{ "moneybag", "💰" },
+	{ "dollar", "💵" },
+	{ "warning", "⚠️" },
+	{ "no_entry", "⛔" },
+	{ "x", "❌" },
+	{ "heavy_check_mark", "✔️" },
+	{ "white_check_mark", "✅" },
+	{ "ballot_box_with_check", "☑️" },
+	{ "question", "❓" },
+	{ "exclamation", "❗" },
+	{ "heavy_plus_sign", "➕" },
+	{ "heavy_minus_sign", "➖" },
+	{ "arrow_right", "➡️" },
+	{ "arrow_left", "⬅️" },
+	{ "arrow_up", "⬆️" },
+	{ "arrow_down", "⬇️" },
+	{ "arrows_counterclockwise", "🔄" },
+	{ "recycle", "♻️" },
+	{ "information_source", "ℹ️" },
+	{ "i", "ℹ️" },
+	{ "construction", "🚧" },
+	{ "checkered_flag", "🏁" },
+	{ "triangular_flag_on_post", "🚩" },
+	{ "red_circle", "🔴" },
+	{ "large_blue_circle", "🔵" },
+	{ "white_circle", "⚪" },
+	{ "black_circle", "⚫" },
+	{ "copyright", "©️" },
+	{ "registered", "®️" },
+	{ "tm", "™️" },
+	{ "hash", "#️⃣" },
+	{ "zero", "0️⃣" },
+	{ "one", "1️⃣" },
+	{ "two", "2️⃣" },
+	{ "three", "3️⃣" },
+	{ "new", "🆕" },
+	{ "free", "🆓" },
+	{ "ok", "🆗" },
+	{ "cool", "🆒" },
+	{ "sos", "🆘" },
+	{ "top", "🔝" },
+	{ "soon", "🔜" },
+	{ "speech_balloon", "💬" },
+	{ "thought_balloon", "💭" },
+	{ "hotsprings", "♨️" },
+	{ "globe_with_meridians", "🌐" },
+};
+
+static constexpr size_t emojiCount = sizeof(emojis) / sizeof(emojis[0]);
+
+// ----- Perfect hash ----- \\ 
+
+/*
+	Hash and displace: a first hash puts every shortcode into a bucket, each bucket then gets
+	the seed of a second hash that sends all of its shortcodes to free slots. Built at compile
+	time, a lookup is two hashes and one comparison
+*/
+
+static const size_t bucketCount = 128;
+static const size_t slotCount = 512;
+static const std::uint16_t emptySlot = 0xFFFF;
+
+static_assert(emojiCount < slotCount, "Emoji table needs more slots");
+
+static constexpr std::uint32_t emojiHash(std::string_view str, std::uint32_t seed) {
+	// FNV-1a, seeded
+	std::uint32_t h = 2166136261u ^ (seed * 16777619u);
+	for (char c : str) {
+		h ^= (unsigned char) c;
+		h *= 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+struct EmojiHashTable {
+	std::uint16_t seeds[bucketCount];
+	std::uint16_t slots[slotCount];
+};
+
+static constexpr EmojiHashTable buildHashTable() {
+	EmojiHashTable table {};
+	for (auto & s : table.slots)
+		s = emptySlot;
+
+	size_t bucket[emojiCount] {};
+	size_t bucketSize[bucketCount] {};
+	size_t largest = 0;
+	for (size_t i = 0; i < emojiCount; i++) {
+		bucket[i] = emojiHash(emojis[i].shortcode, 0) % bucketCount;
+		largest = std::max(largest, ++bucketSize[bucket[i]]);
+	}
+
+	// Largest buckets first, while most slots are still free
+	for (size_t size = largest; size > 0; size--) {
+		for (size_t b = 0; b < bucketCount; b++) {
+			if (bucketSize[b] != size)
+				continue;
+
+			size_t members[emojiCount] {};
+			size_t count = 0;
+			for (size_t i = 0; i < emojiCount; i++) {
+				if (bucket[i] == b)
+					members[count++] = i;
+			}
+
+			for (std::uint32_t seed = 1; ; seed++) {
+				if (seed == emptySlot)
+					throw "No seed found for an emoji bucket";
+
+				size_t pos[emojiCount] {};
+				bool free = true;
+				for (size_t m = 0; m < count && free; m++) {
+					pos[m] = emojiHash(emojis[members[m]].shortcode, seed) % slotCount;
+					free = table.slots[pos[m]] == emptySlot;
+					for (size_t n = 0; n < m && free; n++)
+						free = pos[n] != pos[m];
+				}
+				if (!free)
+					continue;
+
+				for (size_t m = 0; m < count; m++)
+					table.slots[pos[m]] = (std::uint16_t) members[m];
+				table.seeds[b] = (std::uint16_t) seed;
+				break;
+			}
+		}
+	}
+
+	// Duplicate shortcodes would make one of them unreachable
+	for (size_t i = 0; i < emojiCount; i++) {
+		for (size_t j = i + 1; j < emojiCount; j++) {
+			if (emojis[i].shortcode == emojis[j].shortcode)
+				throw "Duplicate emoji shortcode";
+		}
+	}
+	return table;
+}
+
+static constexpr EmojiHashTable emojiTable = buildHashTable();
+
+static constexpr size_t longestShortcode() {
+	size_t res = 0;
+	for (auto & e : emojis)
+		res = std::max(res, e.shortcode.size());
+	return res;
+}
+
+extern const size_t emojiMaxShortcode = longestShortcode();
+
+const Emoji * emojiFind(std::string_view shortcode) {
+	if (shortcode.size() > emojiMaxShortcode)
+		return nullptr;
+
+	std::uint16_t seed = emojiTable.seeds[emojiHash(shortcode, 0) % bucketCount];
+	std::uint16_t i = emojiTable.slots[emojiHash(shortcode, seed) % slotCount];
+	if (i == emptySlot || emojis[i].shortcode != shortcode)
+		return nullptr;
+	return &emojis[i];
+}
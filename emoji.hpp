@@ -0,0 +1,18 @@
+#pragma once
+#include <string_view>
+
+struct Emoji {
+	std::string_view shortcode; // Without the colons, e.g. "smile"
+	std::string_view utf8;
+};
+
+/*
+	Looks shortcode up in the built-in table. The table is hashed perfectly at compile time,
+	so nothing is allocated and at most one entry is compared
+	@param shortcode Name without the colons
+	@return Entry of the table, which is static. nullptr if there is none with that name
+*/
+const Emoji * emojiFind(std::string_view shortcode);
+
+// Longest shortcode in the table, longer names are never looked up
+extern const size_t emojiMaxShortcode;
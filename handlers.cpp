@@ -1,8 +1,30 @@
+#include <cstring>
+
 #include "inline_handler.hpp"
 #include "parser_handler.hpp"
+#include "emoji.hpp"
 
 void Parser::addDefaultHandlers() {
-	
+	addHandler<UnorderedListHandler>("H_ulist");
+	addHandler<OrderedListHandler>("H_olist");
+	addHandler<HeadingHandler>("H_heading");
+	addHandler<BlockquoteHandler>("H_blockquote");
+	addHandler<HLineHandler>("H_hline");
+	addHandler<CodeHandler>("H_code");
+	addHandler<TableHandler>("H_table");
+	addHandler<ReferenceHandler>("H_reference");
+
+	addInlineHandler<InlineTemplateHandler<'*'>>("I_bold");
+	addInlineHandler<InlineTemplateHandler<'/'>>("I_italic");
+	addInlineHandler<InlineTemplateHandler<'_'>>("I_underlined");
+	addInlineHandler<InlineTemplateHandler<'~'>>("I_strikethrough");
+	addInlineHandler<InlineTemplateHandler<'='>>("I_highlight");
+	addInlineHandler<InlineSmileyHandler>("I_emoji");
+	addInlineHandler<InlineCodeHandler>("I_code");
+	addInlineHandler<InlineModifierHandler>("I_link");
+
+	addHandler<ParagraphHandler>("H_paragraph");
+	addHandlerAlias("H_default", "H_paragraph");
 }
 
 // ------------------------------------ \\ 
@@ -16,12 +38,6 @@ std::unique_ptr<ParserHandler> ParagraphHandler::createNew() {
 	return std::make_unique<ParagraphHandler>();
 }
 
-bool ParagraphHandler::canHandle(Parser * lex) {
-	return 
-		(lex->lastToken == tokSpace) || 
-		(lex->lastToken == tokText);
-}
-
 std::tuple<std::unique_ptr<_ASTElement>, bool> ParagraphHandler::handle(Parser * lex) {
 	if (content == nullptr) {
 		// Remove Spaces in front
@@ -50,6 +66,11 @@ std::unique_ptr<_ASTElement> ParagraphHandler::finish(Parser * lex) {
 	return std::move(content);
 }
 
+bool ParagraphHandler::reset() {
+	content = nullptr;
+	return true;
+}
+
 #pragma endregion ParagraphHandler
 
 #pragma region HeadingHandler
@@ -63,11 +84,37 @@ std::string HeadingHandler::triggerChars() {
 	return "#";
 }
 
-bool HeadingHandler::canHandle(Parser * lex) {
-	return (lex->lastToken == tokSym) && 
-		(lex->lastString[0] == '#') &&
-		(lex->lastInt <= 6) &&
-		(lex->peektok() == tokSpace || lex->peektok() == tokNewline);
+/*
+	Id of a heading and of links to it, so [Intro]#(), (#Intro) and "# Intro" all agree
+	@param text Heading text or link target, surrounding spaces are dropped before Parser::make_id()
+*/
+static std::string anchorId(Parser * lex, std::string_view text) {
+	size_t first = text.find_first_not_of(' ');
+	if (first == std::string_view::npos)
+		return "";
+	text = text.substr(first, text.find_last_not_of(' ') - first + 1);
+
+	std::string id;
+	std::tie(id, std::ignore) = lex->make_id(text);
+	return id;
+}
+
+// Whether the heading holds a []{$no_toc}, also inside styled text and other modifiers
+static bool excludedFromToc(_ASTInlineElement * element) {
+	if (ASTModifier * modifier = dynamic_cast<ASTModifier *>(element))
+		return modifier->getCommand().function == "no_toc" ||
+			(modifier->getContent() != nullptr && excludedFromToc(modifier->getContent()));
+
+	if (ASTTextModification * modification = dynamic_cast<ASTTextModification *>(element))
+		return modification->getContent() != nullptr && excludedFromToc(modification->getContent());
+
+	if (ASTInlineText * text = dynamic_cast<ASTInlineText *>(element)) {
+		for (size_t i = 0; i < text->size(); i++) {
+			if (excludedFromToc(text->at(i).get()))
+				return true;
+		}
+	}
+	return false;
 }
 
 std::tuple<std::unique_ptr<_ASTElement>, bool> HeadingHandler::handle(Parser * lex) {
@@ -89,13 +136,34 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> HeadingHandler::handle(Parser * l
 	std::tie(t, std::ignore) = lex->parseText(false);
 	lex->gettok(); // Consume newline
 
-	return std::make_tuple(std::make_unique<ASTHeading>(level, std::move(t)), true);
+	std::unique_ptr<ASTHeading> heading = std::make_unique<ASTHeading>(level, std::move(t));
+	ASTDocument * doc = lex->getDocument().get();
+	std::string text = heading->getContent()->literalText();
+	std::string id = anchorId(lex, text);
+	text.erase(text.find_last_not_of(' ') + 1);
+
+	if (!id.empty()) {
+		id = doc->anchors().add(std::move(id), heading.get());
+		heading->setId(id);
+		// Links to it resolve through the reference, also those parsed before
+		doc->references().get('#', id)->defined = true;
+	}
+
+	// Without an id there is nothing to link to
+	if (!heading->getId().empty() && !excludedFromToc(heading->getContent()))
+		doc->toc().add(level, heading->getId(), std::move(text));
+
+	return std::make_tuple(std::move(heading), true);
 }
 
 std::unique_ptr<_ASTElement> HeadingHandler::finish(Parser * lex) {
 	return nullptr;
 }
 
+bool HeadingHandler::reset() {
+	return true;
+}
+
 #pragma endregion HeadingHandler
 
 #pragma region HLineHandler
@@ -109,13 +177,6 @@ std::string HLineHandler::triggerChars() {
 	return "-";
 }
 
-bool HLineHandler::canHandle(Parser * lex) {
-	return (lex->lastToken == tokSym) && 
-		(lex->lastString[0] == '-') &&
-		(lex->lastInt >= 3) &&
-		(lex->peektok() == tokNewline);
-}
-
 std::tuple<std::unique_ptr<_ASTElement>, bool> HLineHandler::handle(Parser * lex) {
 	lex->gettok(); // Consume ---
 	lex->gettok(); // Consume Newline
@@ -126,6 +187,10 @@ std::unique_ptr<_ASTElement> HLineHandler::finish(Parser * lex) {
 	return nullptr;
 }
 
+bool HLineHandler::reset() {
+	return true;
+}
+
 #pragma endregion HLineHandler
 
 #pragma region BlockquoteHandler
@@ -139,21 +204,6 @@ std::string BlockquoteHandler::triggerChars() {
 	return ">";
 }
 
-bool BlockquoteHandler::canHandle(Parser * lex) {
-	if (content != nullptr)
-		return (canHandleBlock(lex) && (indentStyle == ' ' || indentStyle == 0)) ||
-			(indentStyle == '>' || indentStyle == 0) &&
-			((lex->lastToken == tokSym) &&
-			(lex->lastString[0] == '>') && 
-			(lex->lastInt == (centered ? 2 : 1)) && 
-			(lex->peektok() == tokSpace || lex->peektok() == tokNewline));
-
-	return (lex->lastToken == tokSym) &&
-		(lex->lastString[0] == '>') && 
-		(lex->lastInt <= 2) && 
-		(lex->peektok() == tokSpace || lex->peektok() == tokNewline);
-}
-
 std::tuple<std::unique_ptr<_ASTElement>, bool> BlockquoteHandler::handle(Parser * lex) {
 	if (content != nullptr && indentStyle == 0)
 		indentStyle = lex->lastString[0];
@@ -174,26 +224,21 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> BlockquoteHandler::handle(Parser
 			lex->gettok(); // Consume space
 
 		// Else dont consume newline, parseLine will take care of that
-		std::unique_ptr<_ASTElement> e;
-		bool redo;
-		do {
-			std::tie(e, redo) = lex->parseLine(handler);
-			content->addElement(e);
-		} while (redo);
 	}
 
 	return std::make_tuple(nullptr, false);
 }
 
 std::unique_ptr<_ASTElement> BlockquoteHandler::finish(Parser * lex) {
-	// if (handler != nullptr) {
-	// 	std::unique_ptr<_ASTElement> e = std::move(handler->finish(lex));
-	// 	content->addElement(e);
-	// }
-	finishBlock(lex);
 	return std::move(content);
 }
 
+bool BlockquoteHandler::reset() {
+	centered = false;
+	indentStyle = 0;
+	return BlockHandler<ASTBlockquote>::reset();
+}
+
 #pragma endregion BlockquoteHandler
 
 #pragma region UnorderedListHandler
@@ -207,14 +252,6 @@ std::string UnorderedListHandler::triggerChars() {
 	return "-";
 }
 
-bool UnorderedListHandler::canHandle(Parser * lex) {
-	return canHandleBlock(lex) ||
-		((lex->lastToken == tokSym) &&
-		(lex->lastString[0] == '-') && 
-		(lex->lastInt == 1) && 
-		(lex->peektok() == tokSpace || lex->peektok() == tokNewline));
-}
-
 std::tuple<std::unique_ptr<_ASTElement>, bool> UnorderedListHandler::handle(Parser * lex) {
 	if (list == nullptr) {
 		// Create List
@@ -227,8 +264,7 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> UnorderedListHandler::handle(Pars
 	}
 	else {
 		// '-' Block
-		if (handler != nullptr)
-			content->addElement(handler->finish(lex));
+		lex->finishNested();
 		if (content != nullptr)
 			list->addElement(content);
 
@@ -240,24 +276,22 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> UnorderedListHandler::handle(Pars
 			lex->gettok(); // Consume space
 
 		// Else dont consume newline, parseLine will take care of that
-		std::unique_ptr<_ASTElement> e;
-		bool redo;
-		do {
-			std::tie(e, redo) = lex->parseLine(handler);
-			content->addElement(e);
-		} while (redo);
 	}
 
 	return std::make_tuple(nullptr, false);
 }
 
 std::unique_ptr<_ASTElement> UnorderedListHandler::finish(Parser * lex) {
-	finishBlock(lex);
 	if (list != nullptr)
 		list->addElement(content);
 	return std::move(list);
 }
 
+bool UnorderedListHandler::reset() {
+	list = nullptr;
+	return BlockHandler<ASTListElement>::reset();
+}
+
 #pragma endregion UnorderedListHandler
 
 #pragma region OrderedListHandler
@@ -271,13 +305,6 @@ std::string OrderedListHandler::triggerChars() {
 	return "";
 }
 
-bool OrderedListHandler::canHandle(Parser * lex) {
-	return canHandleBlock(lex) ||
-		((lex->lastToken == tokNumber) &&
-		(lex->lastString[lex->lastString.length()] == '.') &&
-		(lex->peektok() == tokSpace || lex->peektok() == tokNewline));
-}
-
 std::tuple<std::unique_ptr<_ASTElement>, bool> OrderedListHandler::handle(Parser * lex) {
 	if (list == nullptr) {
 		// Create List
@@ -290,8 +317,7 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> OrderedListHandler::handle(Parser
 	}
 	else {
 		// '<Num>.' Block
-		if (handler != nullptr)
-			content->addElement(handler->finish(lex));
+		lex->finishNested();
 		if (content != nullptr)
 			list->addElement(content);
 
@@ -303,24 +329,22 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> OrderedListHandler::handle(Parser
 			lex->gettok(); // Consume space
 
 		// Else dont consume newline, parseLine will take care of that
-		std::unique_ptr<_ASTElement> e;
-		bool redo;
-		do {
-			std::tie(e, redo) = lex->parseLine(handler);
-			content->addElement(e);
-		} while (redo);
 	}
 
 	return std::make_tuple(nullptr, false);
 }
 
 std::unique_ptr<_ASTElement> OrderedListHandler::finish(Parser * lex) {
-	finishBlock(lex);
 	if (list != nullptr)
 		list->addElement(content);
 	return std::move(list);
 }
 
+bool OrderedListHandler::reset() {
+	list = nullptr;
+	return BlockHandler<ASTListElement>::reset();
+}
+
 #pragma endregion OrderedListHandler
 
 #pragma region CodeHandler
@@ -334,15 +358,6 @@ std::string CodeHandler::triggerChars() {
 	return "`";
 }
 
-bool CodeHandler::canHandle(Parser * lex) {
-	if (fenceCount != 0)
-		return true;
-	return 
-		(lex->lastToken == tokSym) && 
-		(lex->lastString[0] == '`') &&
-		(lex->lastInt >= 3);
-}
-
 std::tuple<std::unique_ptr<_ASTElement>, bool> CodeHandler::handle(Parser * lex) {
 	if (fenceCount == 0) {
 		// Remove Spaces in front
@@ -360,96 +375,362 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> CodeHandler::handle(Parser * lex)
 		return std::make_tuple(nullptr, false);
 	}
 
-	// std::unique_ptr<ASTInlineText> line, e;
-	// std::unique_ptr<_ASTInlineElement> e;
-	// bool eol;
-	std::string currLine;
+	if (lex->blockLevel() == 0 && !hasBody) {
+		// Lines reach us unchanged, take everything up to the closing fence as it is
+		std::string_view text;
+		bool closed;
+		std::tie(text, closed) = lex->readFenced('`', fenceCount);
+		if (!closed) {
+			// Ended on EOF, finish() gets the lines read
+			if (!text.empty() && text.back() == '\n')
+				text.remove_suffix(1);
+			body.assign(text);
+			hasBody = true;
+			return std::make_tuple(nullptr, false);
+		}
+
+		std::unique_ptr<ASTCodeBlock> code = lex->stableInput() ?
+			std::make_unique<ASTCodeBlock>(lang, text) :
+			std::make_unique<ASTCodeBlock>(lang, std::string(text));
+		lex->gettok(); // Consume ```
+		lex->gettok(); // Consume newline
+		return std::make_tuple(std::move(code), true);
+	}
 
-	// Own read function so multiple spaces are represented correctly
-	// while (
-	// 	(lex->lastToken != tokNewline) &&
-	// 	(lex->lastToken != tokEOF) &&
-	// 	(lex->lastToken != tokSym || lex->lastString[0] != '`' || lex->lastInt != fenceCount || (lex->peektok() != tokNewline && lex->peektok() != tokEOF))
-	// 	) {
-	// 	// Take text literally
-	// 	if (lex->lastToken == tokText || lex->lastToken == tokNumber)
-	// 		currLine += lex->lastString;
-	// 	else
-	// 		currLine += std::string(lex->lastInt, lex->lastString[0]);
-	// 	lex->gettok(); // Consume inserted Text
-	// }
+	// Inside a container every line has its prefix removed first, so read line by line
+	std::string currLine;
 	bool eol;
 	int count = fenceCount;
 	std::tie(currLine, eol) = lex->readUntil([count](Parser * lex) {
 		return (lex->lastToken == tokSym && lex->lastString[0] == '`' && lex->lastInt == count && (lex->peektok() == tokNewline || lex->peektok() == tokEOF));
-	});
+	}, true);
 
 	// One only escapes if it is newline or end of block
 	
-	content.push_back(std::make_unique<ASTPlainText>(currLine));
+	if (hasBody)
+		body += '\n';
+	body += currLine;
+	hasBody = true;
 	if (!eol) {
 		// Finishing symbol
 		lex->gettok(); // Consume ```
 		lex->gettok(); // Consume newline
-		std::unique_ptr<ASTCodeBlock> code = std::make_unique<ASTCodeBlock>(lang);
-		for (auto & e : content)
-			code->addElement(std::move(e));
-		return std::make_tuple(std::move(code), true);
+		return std::make_tuple(std::make_unique<ASTCodeBlock>(lang, std::move(body)), true);
 	}
 
-	// do {
-
-
-		// std::tie(e, eol) = lex->parseText(false, true, false, '`');
-		
-		// if (!eol) {
-		// 	// Possibly ended
-		// 	if (lex->lastInt == fenceCount && (lex->peektok() == tokNewline || lex->peektok() == tokEOF)) {
-		// 		// Block ended
-		// 		lex->gettok(); // Consume ```
-		// 		lex->gettok(); // Consume Newline
-		// 		content.push_back(std::move(e));
-		// 		std::unique_ptr<ASTCodeBlock> code = std::make_unique<ASTCodeBlock>(lang);
-		// 		for (auto & e : content)
-		// 			code->addElement(std::move(e));
-		// 		return std::make_tuple(std::move(code), true);
-		// 	}
-		// 	else {
-		// 		// Treat as regular text
-		// 		if (line == nullptr)
-		// 			line = std::move(e);
-		// 		else
-		// 			line->addElement(std::move(e));
-				
-		// 		line->addElement(std::make_unique<ASTPlainText>(lex->lastInt, '`'));
-		// 		lex->gettok(); // Consume `
-		// 	}
-		// }
-		// else {
-		// 	lex->gettok(); // Consume Newline
-		// 	if (e == nullptr)
-		// 		e = std::make_unique<ASTInlineText>(); // Empty Lines are taken seriously
-		// 	if (line == nullptr)
-		// 		line = std::move(e);
-		// 	else
-		// 		line->addElement(std::move(e));
-		// }
-	// } while (!eol);
-
-	// content.push_back(std::move(line));
 	// Dont finish, dont return anything
 	return std::make_tuple(nullptr, false);
 }
 
 std::unique_ptr<_ASTElement> CodeHandler::finish(Parser * lex) {
 	std::unique_ptr<ASTParagraph> p = std::make_unique<ASTParagraph>();
-	for (auto & e : content)
-		p->addElement(std::move(e));
+	if (!hasBody)
+		return p;
+
+	size_t start = 0;
+	while (true) {
+		size_t end = std::min(body.find('\n', start), body.size());
+		p->addElement(std::make_unique<ASTPlainText>(body.substr(start, end - start)));
+		if (end == body.size())
+			break;
+		start = end + 1;
+	}
 	return std::move(p);
 }
 
+bool CodeHandler::reset() {
+	// Keeps the capacity of body and lang
+	body.clear();
+	hasBody = false;
+	fenceCount = 0;
+	lang.clear();
+	firstLine = nullptr;
+	return true;
+}
+
 #pragma endregion
 
+#pragma region TableHandler
+// ----- TableHandler ----- \\ 
+
+/*
+	@return Position of the first '|' in line that is not escaped, line.size() if there is none
+*/
+static size_t findCellEnd(std::string_view line) {
+	size_t pos = 0;
+	while (true) {
+		const char * p = (const char *) std::memchr(line.data() + pos, '|', line.size() - pos);
+		if (p == nullptr)
+			return line.size();
+		pos = p - line.data();
+
+		// An odd number of backslashes in front makes it an escape sequence
+		size_t b = pos;
+		while (b != 0 && line[b - 1] == '\\')
+			b--;
+		if ((pos - b) % 2 == 0)
+			return pos;
+		pos++;
+	}
+}
+
+static std::string_view trimCell(std::string_view cell) {
+	size_t first = cell.find_first_not_of(' ');
+	if (first == std::string_view::npos)
+		return cell.substr(0, 0);
+	return cell.substr(first, cell.find_last_not_of(' ') + 1 - first);
+}
+
+/*
+	Reads a row of alignments like "| :-- | --: | :-: |", line starting after the first '|'
+	@param alignment Gets 'l', 'c', 'r' or 0 for every column
+	@return Whether line is an alignment row
+*/
+static bool readAlignment(std::string_view line, std::vector<char> & alignment) {
+	while (true) {
+		size_t end = std::min(line.find('|'), line.size());
+		std::string_view cell = trimCell(line.substr(0, end));
+
+		if (cell.empty()) {
+			// Only allowed after the closing '|'
+			if (end != line.size() || alignment.empty())
+				return false;
+			return true;
+		}
+
+		bool left = cell.front() == ':';
+		bool right = cell.size() > 1 && cell.back() == ':';
+		std::string_view dashes = cell.substr(left, cell.size() - left - right);
+		if (dashes.empty() || dashes.find_first_not_of('-') != std::string_view::npos)
+			return false;
+		alignment.push_back(left && right ? 'c' : left ? 'l' : right ? 'r' : 0);
+
+		if (end == line.size())
+			return true;
+		line.remove_prefix(end + 1);
+	}
+}
+
+std::unique_ptr<ParserHandler> TableHandler::createNew() {
+	return std::make_unique<TableHandler>();
+}
+
+std::string TableHandler::triggerChars() {
+	return "|";
+}
+
+std::unique_ptr<ASTTableCell> TableHandler::parseCell(Parser * lex, std::string_view line) {
+	size_t end = findCellEnd(line);
+	std::string_view cell = trimCell(line.substr(0, end));
+	std::unique_ptr<ASTTableCell> res;
+
+	if (lex->isPlain(cell)) {
+		// Nothing to parse, keep it as written
+		res = lex->stableInput() ?
+			std::make_unique<ASTTableCell>(cell) :
+			std::make_unique<ASTTableCell>(std::string(cell));
+		lex->skip(end);
+	}
+	else {
+		while (lex->lastToken == tokSpace)
+			lex->gettok(); // Eat Space
+		std::unique_ptr<ASTInlineText> text;
+		std::tie(text, std::ignore) = lex->parseText(false, true, true, '|');
+		if (text != nullptr)
+			text->trimRight();
+		res = std::make_unique<ASTTableCell>(std::move(text));
+	}
+
+	if (lex->lastToken == tokSym && lex->lastString[0] == '|') {
+		if (lex->lastInt > 1)
+			lex->lastInt--; // Next cell starts on the rest of the run
+		else
+			lex->gettok(); // Consume |
+	}
+	return res;
+}
+
+std::tuple<std::unique_ptr<_ASTElement>, bool> TableHandler::handle(Parser * lex) {
+	if (table == nullptr)
+		table = std::make_unique<ASTTable>();
+
+	if (lex->lastInt > 1)
+		lex->lastInt--; // Empty first cell
+	else
+		lex->gettok(); // Eat |
+
+	std::string_view line = lex->restOfLine();
+	std::vector<char> alignment;
+	if (rows++ == 1 && readAlignment(line, alignment)) {
+		table->setAlignment(std::move(alignment));
+		lex->skip(line.size());
+		lex->gettok(); // Consume newline
+		return std::make_tuple(nullptr, false);
+	}
+
+	std::unique_ptr<ASTTableRow> row = std::make_unique<ASTTableRow>();
+	while (lex->lastToken != tokNewline && lex->lastToken != tokEOF) {
+		line = lex->restOfLine();
+		if (trimCell(line).empty()) {
+			// Spaces after the closing '|'
+			lex->skip(line.size());
+			break;
+		}
+		row->addElement(parseCell(lex, line));
+	}
+
+	if (lex->lastToken == tokNewline)
+		lex->gettok(); // Consume newline
+
+	table->addElement(std::move(row));
+	return std::make_tuple(nullptr, false);
+}
+
+std::unique_ptr<_ASTElement> TableHandler::finish(Parser *) {
+	return std::move(table);
+}
+
+bool TableHandler::reset() {
+	table = nullptr;
+	rows = 0;
+	return true;
+}
+
+#pragma endregion TableHandler
+
+#pragma region ReferenceHandler
+// ----- ReferenceHandler ----- \\ 
+
+/*
+	Splits a definition line like "%(name): rest" or "^id: rest"
+	@param form '(', '{', '<' or '^'
+	@param rest Where the part after ':' starts in line, spaces skipped
+	@return Whether line is a definition
+*/
+static bool readDefinition(std::string_view line, char & form, std::string_view & name, size_t & rest) {
+	size_t colon;
+
+	if (line.size() > 1 && line[0] == '^') {
+		form = '^';
+		colon = line.find(':');
+		if (colon == std::string_view::npos)
+			return false;
+		name = line.substr(1, colon - 1);
+		if (name.find(' ') != std::string_view::npos)
+			return false;
+	}
+	else if (line.size() > 1 && line[0] == '%') {
+		form = line[1];
+		char close;
+		switch (form) {
+		case '(': close = ')'; break;
+		case '{': close = '}'; break;
+		case '<': close = '>'; break;
+		default: return false;
+		}
+		colon = line.find(close, 2) + 1;
+		if (colon == 0 || colon == line.size() || line[colon] != ':')
+			return false;
+		name = line.substr(2, colon - 3);
+	}
+	else
+		return false;
+
+	rest = std::min(line.find_first_not_of(' ', colon + 1), line.size());
+	return !name.empty();
+}
+
+std::unique_ptr<ParserHandler> ReferenceHandler::createNew() {
+	return std::make_unique<ReferenceHandler>();
+}
+
+std::string ReferenceHandler::triggerChars() {
+	return "%^";
+}
+
+bool ReferenceHandler::canHandle(Parser * lex) {
+	if (open != nullptr) {
+		// Indented text goes on
+		return 
+			(lex->lastToken == tokSpace) &&
+			(lex->lastInt >= 2) &&
+			(lex->peektok() != tokNewline);
+	}
+
+	if (lex->lastToken != tokSym || lex->lastInt != 1)
+		return false;
+	char form;
+	std::string_view name;
+	size_t rest;
+	return readDefinition(lex->restOfLine(), form, name, rest);
+}
+
+std::tuple<std::unique_ptr<_ASTElement>, bool> ReferenceHandler::handle(Parser * lex) {
+	std::unique_ptr<ASTInlineText> text;
+
+	if (open != nullptr) {
+		while (lex->lastToken == tokSpace)
+			lex->gettok(); // Eat Indentation
+		std::tie(text, std::ignore) = lex->parseText(false);
+		if (text != nullptr) {
+			open->content->addElement(std::make_unique<ASTPlainText>(' '));
+			open->content->addElements(text->takeElements(0));
+		}
+		if (lex->lastToken == tokNewline)
+			lex->gettok(); // Consume newline
+		return std::make_tuple(nullptr, false);
+	}
+
+	std::string_view line = lex->restOfLine();
+	char form;
+	std::string_view name;
+	size_t rest;
+	readDefinition(line, form, name, rest);
+
+	std::string id;
+	std::tie(id, std::ignore) = lex->make_id(std::string(name));
+	Reference * ref = lex->getDocument()->references().get(form == '^' ? '^' : '%', id);
+	if (ref->defined)
+		ref = &unused;
+	ref->defined = true;
+
+	if (form == '(' || form == '{') {
+		std::string_view command = line.substr(rest);
+		if (form == '(') {
+			size_t end = std::min(command.find(' '), command.size());
+			ref->url = command.substr(0, end);
+			command.remove_prefix(end);
+		}
+		ref->command = lex->parseCommand(command);
+
+		lex->skip(line.size());
+		if (lex->lastToken == tokNewline)
+			lex->gettok(); // Consume newline
+		return std::make_tuple(nullptr, true);
+	}
+
+	lex->skip(rest);
+	std::tie(text, std::ignore) = lex->parseText(false);
+	ref->content = text != nullptr ? std::move(text) : std::make_unique<ASTInlineText>();
+	open = ref;
+	if (lex->lastToken == tokNewline)
+		lex->gettok(); // Consume newline
+	return std::make_tuple(nullptr, false);
+}
+
+std::unique_ptr<_ASTElement> ReferenceHandler::finish(Parser *) {
+	// Nothing to insert, the definition is in the references of the document
+	return nullptr;
+}
+
+bool ReferenceHandler::reset() {
+	open = nullptr;
+	unused = Reference();
+	return true;
+}
+
+#pragma endregion ReferenceHandler
+
 
 // ------------------------------------- \\ 
 // ---------- Inline Handlers ---------- \\ 
@@ -466,12 +747,6 @@ std::string InlineCodeHandler::triggerChars() {
 	return "`";
 }
 
-bool InlineCodeHandler::canHandle(Parser * lex) {
-	return (lex->lastToken == tokSym) &&
-		(lex->lastString[0] == '`') &&
-		(lex->peektok() != tokSpace) && (lex->peektok() != tokNewline);
-}
-
 std::tuple<std::unique_ptr<_ASTInlineElement>, bool> InlineCodeHandler::handle(Parser * lex) {
 	
 	// If there are no indicators left open, e.g. **** -> *<firstContent>**<secondContent>*
@@ -481,7 +756,7 @@ std::tuple<std::unique_ptr<_ASTInlineElement>, bool> InlineCodeHandler::handle(P
 	lex->gettok(); // Consume opening indicator
 	std::unique_ptr<ASTInlineText> content;
 	bool endOfLine;
-	std::tie(content, endOfLine) = lex->parseText(false, true, false, '`');
+	std::tie(content, endOfLine) = lex->parseText(false, true, false, '`', true);
 	
 	if (!endOfLine) {
 		// Ended on indicator
@@ -496,6 +771,10 @@ std::tuple<std::unique_ptr<_ASTInlineElement>, bool> InlineCodeHandler::handle(P
 	return std::make_tuple(std::move(content), true);
 }
 
+bool InlineCodeHandler::reset() {
+	return true;
+}
+
 #pragma endregion
 
 #pragma region InlineModifierHandler
@@ -509,10 +788,134 @@ std::string InlineModifierHandler::triggerChars() {
 	return "[](){}<>\"!^#%";
 }
 
-bool InlineModifierHandler::canHandle(Parser * lex) {
-	return (lex->lastToken == tokSym) &&
-		(lex->lastString[0] == '[') &&
-		(lex->peektok() != tokSpace) && (lex->peektok() != tokNewline);
+/*
+	Grammar of the forms that can follow [text], one row each. Looked up by the symbol after ']',
+	which is also the type of the ASTModifier. A new form only needs a new row
+*/
+struct ModifierForm {
+	char symbol;
+	char opening; // Single symbol required after symbol, 0 if none
+	bool openingOptional; // Valid even if opening is missing, without url and command
+	char urlEnd; // url is read until space or urlEnd, 0 if the form has no url
+	bool urlFromContent; // url is the id of the content instead
+	char close; // Ends the command, unless inside quotes
+	char quote;
+};
+
+static const ModifierForm modifierForms[] = {
+	{'(', 0,   false, ')', false, ')', '"'}, // [text](url command)
+	{'!', '(', false, ')', false, ')', '"'}, // [text]!(url command)
+	{'^', '(', false, ')', false, ')', '"'}, // [text]^(id command)
+	{'#', '(', true,  0,   true,  ')', '"'}, // [text]#(command)
+	{'<', '%', false, '>', false, '>', '"'}, // [text]<%name command>
+	{'{', 0,   false, 0,   false, '}', '"'}, // [text]{command}
+};
+
+static bool isSingleSym(Parser * lex, char sym) {
+	return lex->lastToken == tokSym && lex->lastString[0] == sym && lex->lastInt == 1;
+}
+
+// Ends the url on a space or the terminator of the form
+struct ModifierUrlEnd {
+	char end;
+
+	bool operator()(Parser * lex) const {
+		return (lex->lastToken == tokSpace) || (lex->lastToken == tokSym && lex->lastString[0] == end);
+	}
+};
+
+// Ends the command on the closing symbol of the form, if not inside quotes
+struct ModifierCommandEnd {
+	char end;
+	char quote;
+	bool inQuote = false;
+
+	bool operator()(Parser * lex) {
+		if (lex->lastToken == tokSym && lex->lastString[0] == quote) {
+			inQuote = !inQuote;
+		}
+		return (!inQuote && lex->lastToken == tokSym && lex->lastString[0] == end);
+	}
+};
+
+/*
+	Reads the part after ']' as described by form, starting on its symbol
+	@return Whether it is valid. If not, an unknown amount of tokens was consumed
+*/
+static bool readModifier(Parser * lex, const ModifierForm & form, ASTInlineText * content, std::string & url, std::string & command) {
+	bool eol;
+
+	if (form.urlFromContent)
+		url = anchorId(lex, content->literalText());
+	lex->gettok(); // Consume symbol
+
+	if (form.opening) {
+		if (!isSingleSym(lex, form.opening)) {
+			// Valid but no other specification, if the form allows it
+			return form.openingOptional;
+		}
+		lex->gettok(); // Consume opening
+	}
+
+	if (form.urlEnd) {
+		std::tie(url, eol) = lex->readUntil(ModifierUrlEnd{form.urlEnd});
+		if (eol)
+			return false;
+		if (lex->lastToken == tokSpace) {
+			lex->gettok(); // Consume Space
+		}
+	}
+
+	std::tie(command, eol) = lex->readUntil(ModifierCommandEnd{form.close, form.quote});
+	if (eol)
+		return false;
+
+	if (lex->lastInt > 1)
+		lex->lastInt--;
+	else
+		lex->gettok(); // Consume closing
+	return true;
+}
+
+/*
+	Looks up what a modifier refers to: (%name) and !(%name) links, <%name> content, ^(id) footnotes,
+	headings by #() and (#id) and %name in a command. Names not defined yet get a slot their definition fills in later
+	@return The reference, nullptr if the modifier has none
+*/
+static Reference * findReference(Parser * lex, char type, const std::string & url, const ModifierCommand & command, ASTInlineText * content) {
+	if (lex->getDocument() == nullptr)
+		return nullptr;
+	ReferenceTable & refs = lex->getDocument()->references();
+	std::string name;
+
+	switch (type) {
+	case '(':
+	case '!':
+		if (!url.empty() && url[0] == '#') {
+			// Written like the heading, normalized like [text]#()
+			name = anchorId(lex, url.substr(1));
+			return name.empty() ? nullptr : refs.get('#', name);
+		}
+		if (url.empty() || url[0] != '%')
+			break;
+		// [text](%) takes the name from the text
+		std::tie(name, std::ignore) = lex->make_id(url.size() == 1 ? content->literalText() : url.substr(1));
+		return refs.get('%', name);
+	case '#':
+		// url is the id of the text already
+		return refs.get('#', url);
+	case '<':
+		std::tie(name, std::ignore) = lex->make_id(url);
+		return refs.get('%', name);
+	case '^':
+		std::tie(name, std::ignore) = lex->make_id(url);
+		return refs.useFootnote(name);
+	}
+
+	if (command.reference.empty())
+		return nullptr;
+	std::tie(name, std::ignore) = lex->make_id(command.reference);
+	return refs.get('%', name);
 }
 
 std::tuple<std::unique_ptr<_ASTInlineElement>, bool> InlineModifierHandler::handle(Parser * lex) {
@@ -534,222 +937,44 @@ std::tuple<std::unique_ptr<_ASTInlineElement>, bool> InlineModifierHandler::hand
 		}
 		lex->gettok(); // Consume closing indicator
 
-		std::string command;
-		std::string url;
-		int type = 0;
-		bool eol;
-		bool inQuote = false;
-		bool success = false;
-		bool succ;
+		// Modifier part is speculative, roll back here if it turns out invalid
+		Checkpoint modifierStart = lex->checkpoint();
 
-		if (lex->lastToken != tokSym || lex->lastInt != 1) {
+		const ModifierForm * form = nullptr;
+		if (lex->lastToken == tokSym && lex->lastInt == 1) {
+			for (const ModifierForm & candidate : modifierForms) {
+				if (candidate.symbol == lex->lastString[0]) {
+					form = &candidate;
+					break;
+				}
+			}
+		}
+		if (form == nullptr) {
 			// Can not possibly be valid
 			content->prependElement(std::make_unique<ASTPlainText>('['));
 			content->addElement(std::make_unique<ASTPlainText>(']'));
 			return std::make_tuple(std::move(content), true);
 		}
 
-		switch (lex->lastString[0]) {
-			case '(':
-				type = '(';
-				lex->gettok(); // Consume (
-				std::tie(url, eol) = lex->readUntil([](Parser * lex) {
-					return (lex->lastToken == tokSpace) || (lex->lastToken == tokSym && lex->lastString[0] == ')');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastToken == tokSpace) {
-					lex->gettok(); // Consume Space
-				}
-				std::tie(command, eol) = lex->readUntil([&inQuote](Parser * lex) {
-					if (lex->lastToken == tokSym && lex->lastString[0] == '"') {
-						inQuote = !inQuote;
-					}
-					return (!inQuote && lex->lastToken == tokSym && lex->lastString[0] == ')');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastInt > 1)
-					lex->lastInt--;
-				else
-					lex->gettok();
-				// Valid, URL, Command and Type populated
-				success = true;
-				break;
-			case '!':
-				type = '!';
-				lex->gettok(); // Consume !
-				if (lex->lastToken != tokSym || lex->lastString[0] != '(' || lex->lastInt != 1) {
-					// Invalid
-					break;
-				}
-				lex->gettok(); // Consume (
-				std::tie(url, eol) = lex->readUntil([](Parser * lex) {
-					return (lex->lastToken == tokSpace) || (lex->lastToken == tokSym && lex->lastString[0] == ')');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastToken == tokSpace) {
-					lex->gettok(); // Consume Space
-				}
-				std::tie(command, eol) = lex->readUntil([&inQuote](Parser * lex) {
-					if (lex->lastToken == tokSym && lex->lastString[0] == '"') {
-						inQuote = !inQuote;
-					}
-					return (!inQuote && lex->lastToken == tokSym && lex->lastString[0] == ')');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastInt > 1)
-					lex->lastInt--;
-				else
-					lex->gettok();
-				// Valid, URL, Command and Type populated
-				success = true;
-				break;
-			case '^':
-				type = '^';
-				lex->gettok(); // Consume ^
-				if (lex->lastToken != tokSym || lex->lastString[0] != '(' || lex->lastInt != 1) {
-					// Invalid
-					break;
-				}
-				lex->gettok(); // Consume (
-				std::tie(url, eol) = lex->readUntil([](Parser * lex) {
-					return (lex->lastToken == tokSpace) || (lex->lastToken == tokSym && lex->lastString[0] == ')');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastToken == tokSpace) {
-					lex->gettok(); // Consume Space
-				}
-				std::tie(command, eol) = lex->readUntil([&inQuote](Parser * lex) {
-					if (lex->lastToken == tokSym && lex->lastString[0] == '"') {
-						inQuote = !inQuote;
-					}
-					return (!inQuote && lex->lastToken == tokSym && lex->lastString[0] == ')');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastInt > 1)
-					lex->lastInt--;
-				else
-					lex->gettok();
-				// Valid, URL, Command and Type populated
-				success = true;
-				break;
-			case '#':
-				type = '#';
-				std::tie(url, succ) = lex->make_id(content->literalText());
-				if (!succ) {
-					// No valid ID
-					break;
-				}
-				lex->gettok(); // Consume #
-				if (lex->lastToken != tokSym || lex->lastString[0] != '(' || lex->lastInt != 1) {
-					// Valid but no other specification
-				}
-				lex->gettok(); // Consume (
-				std::tie(command, eol) = lex->readUntil([&inQuote](Parser * lex) {
-					if (lex->lastToken == tokSym && lex->lastString[0] == '"') {
-						inQuote = !inQuote;
-					}
-					return (!inQuote && lex->lastToken == tokSym && lex->lastString[0] == ')');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastInt > 1)
-					lex->lastInt--;
-				else
-					lex->gettok();
-				// Valid, URL, Command and Type populated
-				success = true;
-				break;
-			case '<':
-				type = '<';
-				lex->gettok(); // Consume <
-				if (lex->lastToken != tokSym || lex->lastString[0] != '%' || lex->lastInt != 1) {
-					// Invalid
-					break;
-				}
-				lex->gettok(); // Consume %
-				std::tie(url, eol) = lex->readUntil([](Parser * lex) {
-					return (lex->lastToken == tokSpace) || (lex->lastToken == tokSym && lex->lastString[0] == '>');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastToken == tokSpace) {
-					lex->gettok(); // Consume Space
-				}
-				std::tie(command, eol) = lex->readUntil([&inQuote](Parser * lex) {
-					if (lex->lastToken == tokSym && lex->lastString[0] == '"') {
-						inQuote = !inQuote;
-					}
-					return (!inQuote && lex->lastToken == tokSym && lex->lastString[0] == '>');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastInt > 1)
-					lex->lastInt--;
-				else
-					lex->gettok();
-				// Valid, URL, Command and Type populated
-				success = true;
-				break;
-			case '{':
-				type = '{';
-				url = "";
-				lex->gettok(); // Consume {
-				std::tie(command, eol) = lex->readUntil([&inQuote](Parser * lex) {
-					if (lex->lastToken == tokSym && lex->lastString[0] == '"') {
-						inQuote = !inQuote;
-					}
-					return (!inQuote && lex->lastToken == tokSym && lex->lastString[0] == '}');
-				});
-				if (eol) {
-					// Invalid
-					break;
-				}
-				if (lex->lastInt > 1)
-					lex->lastInt--;
-				else
-					lex->gettok();
-				// Valid, URL, Command and Type populated
-				success = true;
-				break;
-			default:
-				// Error, not valid
-				break;
-		}
-
-		if (!success) {
+		std::string url;
+		std::string command;
+		if (!readModifier(lex, *form, content.get(), url, command)) {
+			// Whatever followed ']' is parsed again as regular text
+			lex->restore(modifierStart);
 			content->prependElement(std::make_unique<ASTPlainText>('['));
 			content->addElement(std::make_unique<ASTPlainText>(']'));
-			content->addElement(std::make_unique<ASTPlainText>(type));
-			content->addElement(std::make_unique<ASTPlainText>(url));
-			content->addElement(std::make_unique<ASTPlainText>(command));
 			return std::make_tuple(std::move(content), true);
 		}
 
-		return std::make_tuple(std::make_unique<ASTModifier>(type, url, command, std::move(content)), true);
+		ModifierCommand decoded = lex->parseCommand(command);
+		if (decoded.function == "insert_toc" && lex->getDocument() != nullptr) {
+			// Filled by every heading of the document, including those further down
+			return std::make_tuple(std::make_unique<ASTTableOfContents>(&lex->getDocument()->toc()), true);
+		}
+		Reference * ref = findReference(lex, form->symbol, url, decoded, content.get());
+		std::unique_ptr<ASTModifier> modifier = std::make_unique<ASTModifier>(form->symbol, std::move(url), std::move(decoded), std::move(content));
+		modifier->setReference(ref);
+		return std::make_tuple(std::move(modifier), true);
 	}
 
 	content->prependElement(std::make_unique<ASTPlainText>('['));
@@ -757,6 +982,10 @@ std::tuple<std::unique_ptr<_ASTInlineElement>, bool> InlineModifierHandler::hand
 	return std::make_tuple(std::move(content), true);
 }
 
+bool InlineModifierHandler::reset() {
+	return true;
+}
+
 #pragma endregion
 
 #pragma region InlineSmileyHandler
@@ -770,34 +999,32 @@ std::string InlineSmileyHandler::triggerChars() {
 	return ":";
 }
 
-bool InlineSmileyHandler::canHandle(Parser * lex) {
-	return (lex->lastToken == tokSym) &&
-		(lex->lastString[0] == ':') &&
-		(lex->peektok() != tokSpace) && (lex->peektok() != tokNewline);
-}
-
 std::tuple<std::unique_ptr<_ASTInlineElement>, bool> InlineSmileyHandler::handle(Parser * lex) {
-	
-	// If there are no indicators left open, e.g. **** -> *<firstContent>**<secondContent>*
-	if (lex->lastInt % 2 == 0)
-		return std::make_tuple(nullptr, true);
+	if (lex->lastInt > 1) {
+		// Only the last one of a run can open a shortcode
+		int literal = lex->lastInt - 1;
+		lex->lastInt = 1;
+		return std::make_tuple(std::make_unique<ASTPlainText>(literal, ':'), true);
+	}
 
-	lex->gettok(); // Consume opening indicator
-	std::unique_ptr<ASTInlineText> content;
-	bool endOfLine;
-	std::tie(content, endOfLine) = lex->parseText(false, true, false, ':');
-	
-	if (!endOfLine) {
-		// Ended on indicator
-		lex->gettok(); // Consume closing indicator
-		if (content != nullptr)
-			return std::make_tuple(std::make_unique<ASTEmoji>(content->literalText()), true);
-		return std::make_tuple(nullptr, true);
+	// Shortcodes are short, only look that far for the closing colon
+	std::string_view line = lex->restOfLine();
+	size_t close = line.substr(0, emojiMaxShortcode + 2).find(':', 1);
+	if (close != std::string_view::npos) {
+		const Emoji * emoji = emojiFind(line.substr(1, close - 1));
+		if (emoji != nullptr) {
+			lex->skip(close + 1);
+			return std::make_tuple(std::make_unique<ASTEmoji>(emoji->shortcode, emoji->utf8), true);
+		}
 	}
 
-	content->prependElement(std::make_unique<ASTPlainText>(':'));
+	// Not an emoji, the colon is text and whatever follows is parsed as usual
+	lex->gettok(); // Consume :
+	return std::make_tuple(std::make_unique<ASTPlainText>(':'), true);
+}
 
-	return std::make_tuple(std::move(content), true);
+bool InlineSmileyHandler::reset() {
+	return true;
 }
 
 #pragma endregion
@@ -0,0 +1,370 @@
+#include "highlight.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+static const HighlightLanguage languages[] = {
+	{
+		"c cpp c++ cc cxx h hpp hxx",
+		"alignas alignof asm auto break case catch class concept const consteval constexpr constinit "
+		"const_cast continue co_await co_return co_yield decltype default delete do dynamic_cast else "
+		"enum explicit export extern final for friend goto if inline mutable namespace new noexcept "
+		"operator override private protected public register reinterpret_cast requires restrict return "
+		"sizeof static static_assert static_cast struct switch template this thread_local throw try "
+		"typedef typeid typename union using virtual volatile while",
+		"bool char char8_t char16_t char32_t double float int long short signed unsigned void wchar_t "
+		"size_t ptrdiff_t int8_t int16_t int32_t int64_t uint8_t uint16_t uint32_t uint64_t",
+		"true false nullptr NULL",
+		"//", "/*", "*/",
+		"\"'", "",
+		false, false, true, false, false, false, false, '\''
+	},
+	{
+		"python py python3 py3",
+		"and as assert async await break class continue def del elif else except finally for from "
+		"global if import in is lambda nonlocal not or pass raise return try while with yield match case",
+		"bool bytes dict float frozenset int list object set str tuple type",
+		"True False None",
+		"#", "", "",
+		"\"'", "",
+		false, true, false, true, false, false, false, 0
+	},
+	{
+		"sh bash shell zsh",
+		"if then else elif fi case esac for select while until do done in function time coproc "
+		"break continue return exit export local readonly declare typeset unset shift source alias eval exec trap",
+		"",
+		"true false",
+		"#", "", "",
+		"\"", "'",
+		true, false, false, false, true, true, false, 0
+	},
+	{
+		"json",
+		"",
+		"",
+		"true false null",
+		"", "", "",
+		"\"", "",
+		false, false, false, false, false, false, true, 0
+	},
+};
+
+static const size_t languageCount = sizeof(languages) / sizeof(languages[0]);
+
+const char * highlightKindName(HighlightKind kind) {
+	switch (kind) {
+	case hlKeyword: return "keyword";
+	case hlType: return "type";
+	case hlLiteral: return "literal";
+	case hlString: return "string";
+	case hlNumber: return "number";
+	case hlComment: return "comment";
+	case hlPreprocessor: return "preprocessor";
+	case hlVariable: return "variable";
+	case hlKey: return "key";
+	}
+	return "";
+}
+
+std::string Highlight::toJson() const {
+	std::string obj = "[";
+	for (const HighlightSpan & span : spans) {
+		obj += "{\"start\": " + std::to_string(span.start) + ",";
+		obj += "\"length\": " + std::to_string(span.length) + ",";
+		obj += "\"kind\": \"";
+		obj += highlightKindName(span.kind);
+		obj += "\"},";
+	}
+	if (!spans.empty())
+		obj.erase(std::prev(obj.end()));
+	obj += "]";
+	return obj;
+}
+
+// ----- Word tables ----- \\ 
+
+typedef std::unordered_map<std::string_view, HighlightKind> WordTable;
+
+static void addWords(WordTable & table, std::string_view words, HighlightKind kind) {
+	size_t start = 0;
+	while (start < words.size()) {
+		size_t end = std::min(words.find(' ', start), words.size());
+		if (end > start)
+			table.emplace(words.substr(start, end - start), kind);
+		start = end + 1;
+	}
+}
+
+static WordTable buildWords(const HighlightLanguage & language) {
+	WordTable table;
+	addWords(table, language.keywords, hlKeyword);
+	addWords(table, language.types, hlType);
+	addWords(table, language.literals, hlLiteral);
+	return table;
+}
+
+/*
+	@return Keywords, types and literals of language in one table. Built once for the
+	languages above, every time for any other
+*/
+static const WordTable & wordsOf(const HighlightLanguage & language, WordTable & scratch) {
+	static const std::vector<WordTable> tables = [] {
+		std::vector<WordTable> tables;
+		for (const HighlightLanguage & l : languages)
+			tables.push_back(buildWords(l));
+		return tables;
+	}();
+
+	if (&language >= languages && &language < languages + languageCount)
+		return tables[&language - languages];
+	scratch = buildWords(language);
+	return scratch;
+}
+
+const HighlightLanguage * highlightLanguage(std::string_view lang) {
+	if (lang.empty())
+		return nullptr;
+	for (const HighlightLanguage & language : languages) {
+		std::string_view names = language.names;
+		size_t start = 0;
+		while (start < names.size()) {
+			size_t end = std::min(names.find(' ', start), names.size());
+			std::string_view name = names.substr(start, end - start);
+			if (name.size() == lang.size() && std::equal(name.begin(), name.end(), lang.begin(),
+				[](char a, char b) { return a == ((b >= 'A' && b <= 'Z') ? b - 'A' + 'a' : b); }))
+				return &language;
+			start = end + 1;
+		}
+	}
+	return nullptr;
+}
+
+// ----- Tokenizer ----- \\ 
+
+static bool isWordChar(unsigned char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static bool isDigit(unsigned char c) {
+	return c >= '0' && c <= '9';
+}
+
+static bool startsWith(std::string_view code, size_t pos, std::string_view str) {
+	return !str.empty() && code.compare(pos, str.size(), str) == 0;
+}
+
+/*
+	@return Position after the string opened at pos. End of line or code if it is not closed
+*/
+static size_t skipString(const HighlightLanguage & language, std::string_view code, size_t pos, bool escapes) {
+	char quote = code[pos];
+	auto triple = [code, quote](size_t i) {
+		return i + 2 < code.size() && code[i] == quote && code[i + 1] == quote && code[i + 2] == quote;
+	};
+	if (language.tripleQuotes && triple(pos)) {
+		size_t i = pos + 3;
+		while (i < code.size()) {
+			if (code[i] == '\\' && escapes)
+				i += 2;
+			else if (triple(i))
+				return i + 3;
+			else
+				i++;
+		}
+		return code.size();
+	}
+
+	size_t i = pos + 1;
+	while (i < code.size()) {
+		char c = code[i];
+		if (c == quote)
+			return i + 1;
+		if (c == '\n' && !language.multilineStrings)
+			return i;
+		i += (c == '\\' && escapes) ? 2 : 1;
+	}
+	return code.size();
+}
+
+/*
+	@return Position after the number starting at pos
+*/
+static size_t skipNumber(const HighlightLanguage & language, std::string_view code, size_t pos) {
+	bool hex = code.compare(pos, 2, "0x") == 0 || code.compare(pos, 2, "0X") == 0;
+	size_t i = pos;
+	while (i < code.size()) {
+		char c = code[i];
+		char prev = (i > pos) ? code[i - 1] : 0;
+		if (isWordChar(c) || c == '.')
+			i++;
+		else if ((c == '+' || c == '-') && (hex ? (prev == 'p' || prev == 'P') : (prev == 'e' || prev == 'E')))
+			i++;
+		else if (c == language.digitSeparator && c != 0 && i + 1 < code.size() && isWordChar(code[i + 1]))
+			i++;
+		else
+			break;
+	}
+	return i;
+}
+
+/*
+	@return Position after the shell variable whose '$' is at pos, pos if there is none
+*/
+static size_t skipVariable(std::string_view code, size_t pos) {
+	size_t i = pos + 1;
+	if (i >= code.size())
+		return pos;
+	char c = code[i];
+	if (c == '{') {
+		size_t end = code.find('}', i);
+		return (end == std::string_view::npos || code.substr(i, end - i).find('\n') != std::string_view::npos) ? pos : end + 1;
+	}
+	if (isDigit(c) || (c != 0 && std::strchr("@#?$!*-", c)))
+		return i + 1;
+	while (i < code.size() && isWordChar(code[i]))
+		i++;
+	return (i == pos + 1) ? pos : i;
+}
+
+Highlight highlightCode(const HighlightLanguage & language, std::string_view code) {
+	Highlight result;
+	if (code.size() > UINT32_MAX)
+		return result;
+
+	WordTable scratch;
+	const WordTable & words = wordsOf(language, scratch);
+
+	auto add = [&result](size_t start, size_t end, HighlightKind kind) {
+		if (end > start)
+			result.spans.push_back({ (std::uint32_t) start, (std::uint32_t) (end - start), kind });
+	};
+
+	bool lineStart = true; // Nothing but spaces since the last '\n'
+	size_t pos = 0;
+	while (pos < code.size()) {
+		unsigned char c = code[pos];
+		if (c == '\n') {
+			lineStart = true;
+			pos++;
+			continue;
+		}
+		if (c == ' ' || c == '\t' || c == '\r') {
+			pos++;
+			continue;
+		}
+
+		bool wordStart = pos == 0 || !isWordChar(code[pos - 1]);
+		bool atLineStart = lineStart;
+		lineStart = false;
+		size_t end;
+
+		if (startsWith(code, pos, language.lineComment) &&
+			(!language.wordComments || pos == 0 || (code[pos - 1] != 0 && std::strchr(" \t\n;", code[pos - 1])))) {
+			end = std::min(code.find('\n', pos), code.size());
+			add(pos, end, hlComment);
+		} else if (startsWith(code, pos, language.blockOpen)) {
+			end = code.find(language.blockClose, pos + language.blockOpen.size());
+			end = (end == std::string_view::npos) ? code.size() : end + language.blockClose.size();
+			add(pos, end, hlComment);
+		} else if (c == '#' && language.preprocessor && atLineStart) {
+			// Up to a comment or the end of the line, lines ending on '\' continue it
+			end = pos + 1;
+			while (end < code.size() && code[end] != '\n' &&
+				!startsWith(code, end, language.lineComment) && !startsWith(code, end, language.blockOpen)) {
+				end += (code[end] == '\\' && end + 1 < code.size()) ? 2 : 1;
+			}
+			while (code[end - 1] == ' ' || code[end - 1] == '\t')
+				end--;
+			add(pos, end, hlPreprocessor);
+		} else if (language.quotes.find(c) != std::string_view::npos || language.rawQuotes.find(c) != std::string_view::npos) {
+			end = skipString(language, code, pos, language.quotes.find(c) != std::string_view::npos);
+			HighlightKind kind = hlString;
+			if (language.keys) {
+				size_t next = end;
+				while (next < code.size() && (code[next] == ' ' || code[next] == '\t'))
+					next++;
+				if (next < code.size() && code[next] == ':')
+					kind = hlKey;
+			}
+			add(pos, end, kind);
+		} else if (wordStart && (isDigit(c) || (c == '.' && pos + 1 < code.size() && isDigit(code[pos + 1])))) {
+			end = skipNumber(language, code, pos);
+			add(pos, end, hlNumber);
+		} else if (c == '$' && language.variables) {
+			end = skipVariable(code, pos);
+			if (end == pos)
+				end++;
+			else
+				add(pos, end, hlVariable);
+		} else if (c == '@' && language.decorators && atLineStart && pos + 1 < code.size() && isWordChar(code[pos + 1])) {
+			end = pos + 1;
+			while (end < code.size() && (isWordChar(code[end]) || code[end] == '.'))
+				end++;
+			add(pos, end, hlPreprocessor);
+		} else if (isWordChar(c)) {
+			end = pos + 1;
+			while (end < code.size() && isWordChar(code[end]))
+				end++;
+			auto word = words.find(code.substr(pos, end - pos));
+			if (word != words.end())
+				add(pos, end, word->second);
+		} else {
+			end = pos + 1;
+		}
+		pos = end;
+	}
+	return result;
+}
+
+// ----- HighlightCache ----- \\ 
+
+std::shared_ptr<const Highlight> HighlightCache::get(std::string_view lang, std::string_view code) {
+	const HighlightLanguage * language = highlightLanguage(lang);
+	if (!language)
+		return nullptr;
+
+	// Aliases like c and cpp share entries
+	std::uint64_t key = std::hash<std::string_view>()(code) ^ ((std::uint64_t) (language - languages + 1) * 0x9E3779B97F4A7C15ull);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = entries.find(key);
+		if (it != entries.end() && it->second.language == language && it->second.code == code) {
+			_hits++;
+			return it->second.result;
+		}
+		_misses++;
+	}
+
+	// Tokenize without holding the lock, another thread may do the same code meanwhile
+	std::shared_ptr<const Highlight> result = std::make_shared<const Highlight>(highlightCode(*language, code));
+	if (code.size() > maxBytes)
+		return result;
+
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = entries.find(key);
+	if (it != entries.end()) {
+		bytes -= it->second.code.size();
+		entries.erase(it);
+	}
+	if (bytes + code.size() > maxBytes) {
+		entries.clear();
+		bytes = 0;
+	}
+	entries.emplace(key, Entry{ language, std::string(code), result });
+	bytes += code.size();
+	return result;
+}
+
+void HighlightCache::clear() {
+	std::lock_guard<std::mutex> guard(lock);
+	entries.clear();
+	bytes = 0;
+}
+
+HighlightCache & HighlightCache::shared() {
+	static HighlightCache cache;
+	return cache;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+enum HighlightKind : unsigned char {
+	hlKeyword = 0,
+	hlType,
+	hlLiteral, // true, false, null, None, ...
+	hlString,
+	hlNumber,
+	hlComment,
+	hlPreprocessor, // #include etc. in C, decorators in Python
+	hlVariable, // $name in shell
+	hlKey, // Object keys in JSON
+};
+
+/*
+	@return Name of kind as written to JSON, e.g. "keyword"
+*/
+const char * highlightKindName(HighlightKind kind);
+
+/*
+	Part of the code to colour. Offsets are bytes into the code, which has its lines separated by '\n'
+*/
+struct HighlightSpan {
+	std::uint32_t start;
+	std::uint32_t length;
+	HighlightKind kind;
+};
+
+/*
+	Spans of one piece of code in ascending order, they never overlap.
+	Text between them is plain
+*/
+struct Highlight {
+	std::vector<HighlightSpan> spans;
+
+	std::string toJson() const;
+};
+
+/*
+	How to tokenize one language. Word lists are separated by spaces,
+	empty strings switch a feature off
+*/
+struct HighlightLanguage {
+	std::string_view names; // Fence names, lowercase, e.g. "c cpp c++"
+	std::string_view keywords;
+	std::string_view types;
+	std::string_view literals;
+	std::string_view lineComment; // Runs to the end of the line
+	std::string_view blockOpen; // Runs to blockClose, may span lines
+	std::string_view blockClose;
+	std::string_view quotes; // Chars opening a string closed by the same one, backslash escapes
+	std::string_view rawQuotes; // As quotes but without escapes
+	bool multilineStrings; // Strings may span lines, otherwise they end at '\n'
+	bool tripleQuotes; // """ and ''' strings spanning lines
+	bool preprocessor; // '#' first on a line starts a directive running to the end of the line
+	bool decorators; // '@' before a name marks it hlPreprocessor
+	bool variables; // $name, ${...} and $1 are hlVariable
+	bool wordComments; // lineComment only counts at the start of a word
+	bool keys; // Strings followed by ':' are hlKey
+	char digitSeparator; // Allowed between digits of a number, e.g. 1'000 in C++. 0 if none
+};
+
+/*
+	@param lang Fence name as written, case is ignored
+	@return Language of lang, nullptr if there is none
+*/
+const HighlightLanguage * highlightLanguage(std::string_view lang);
+
+/*
+	Tokenizes code without any caching
+	@param language Language of code, see highlightLanguage()
+	@param code Text to highlight, lines separated by '\n'
+*/
+Highlight highlightCode(const HighlightLanguage & language, std::string_view code);
+
+/*
+	Remembers highlighted code by a hash of language and text, so the same snippet
+	is only tokenized once no matter how many blocks and documents repeat it.
+	Entries are checked against the text on a hit, a collision is never returned.
+	Safe to use from several threads
+*/
+class HighlightCache {
+protected:
+
+	struct Entry {
+		const HighlightLanguage * language;
+		std::string code;
+		std::shared_ptr<const Highlight> result;
+	};
+
+	std::unordered_map<std::uint64_t, Entry> entries;
+	mutable std::mutex lock;
+
+	// Bytes of code held by entries. Everything is dropped once it would exceed maxBytes
+	size_t bytes = 0;
+	size_t maxBytes;
+
+	size_t _hits = 0;
+	size_t _misses = 0;
+
+public:
+
+	/*
+		@param maxBytes How much code to keep at most, larger snippets are highlighted but never kept
+	*/
+	HighlightCache(size_t maxBytes = 64 * 1024 * 1024) : maxBytes(maxBytes) {}
+
+	/*
+		@param lang Fence name as written
+		@param code Text to highlight
+		@return Spans of code, nullptr if lang is no known language. Shared with every other
+		caller asking for the same code, it stays valid after the cache is cleared
+	*/
+	std::shared_ptr<const Highlight> get(std::string_view lang, std::string_view code);
+
+	void clear();
+
+	size_t hits() const {
+		std::lock_guard<std::mutex> guard(lock);
+		return _hits;
+	}
+
+	size_t misses() const {
+		std::lock_guard<std::mutex> guard(lock);
+		return _misses;
+	}
+
+	/*
+		@return Cache used by ASTCodeBlock, shared by every document of the process
+	*/
+	static HighlightCache & shared();
+};
@@ -17,39 +17,31 @@ public:
 		return std::string(1, indicator);
 	}
 
+	// An even run opens nothing, e.g. ** is literal text. Any run can close though
 	bool canHandle(Parser * lex) {
 		return (lex->lastToken == tokSym) &&
-			(lex->lastString[0] == indicator) &&
+			(lex->lastString[0] == indicator) && (lex->lastInt % 2 == 1) &&
 			(lex->peektok() != tokSpace) && (lex->peektok() != tokNewline);
 	}
 
+	int delimiter() {
+		return indicator;
+	}
+
+	// Only reached if called directly, parseText() pairs the runs itself
 	std::tuple<std::unique_ptr<_ASTInlineElement>, bool> handle(Parser * lex) {
-		
-		// If there are no indicators left open, e.g. **** -> *<firstContent>**<secondContent>*
-		if (lex->lastInt % 2 == 0)
-			return std::make_tuple(nullptr, true);
-
-		lex->gettok(); // Consume opening indicator
-		std::unique_ptr<ASTInlineText> content;
-		bool endOfLine;
-		std::tie(content, endOfLine) = lex->parseText(false, true, true, indicator);
-		
-		if (!endOfLine) {
-			// Ended on indicator
-			lex->gettok(); // Consume closing indicator
-			if (content != nullptr)
-				return std::make_tuple(std::make_unique<ASTTextModification>(indicator, std::move(content)), true);
-			return std::make_tuple(nullptr, true);
-		}
-
-		content->prependElement(std::make_unique<ASTPlainText>(1, indicator));
-
-		return std::make_tuple(std::move(content), true);
+		std::unique_ptr<_ASTInlineElement> res = std::make_unique<ASTPlainText>(lex->lastInt, indicator);
+		lex->gettok(); // Consume indicator
+		return std::make_tuple(std::move(res), true);
 	}
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) {
 		return nullptr;
 	}
+
+	bool reset() override {
+		return true;
+	}
 };
 
 class InlineCodeHandler : public InlineHandler {
@@ -63,9 +55,15 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return (lex->lastToken == tokSym) &&
+			(lex->lastString[0] == '`') &&
+			(lex->peektok() != tokSpace) && (lex->peektok() != tokNewline);
+	}
 
 	std::tuple<std::unique_ptr<_ASTInlineElement>, bool> handle(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class InlineModifierHandler : public InlineHandler {
@@ -79,9 +77,15 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return (lex->lastToken == tokSym) &&
+			(lex->lastString[0] == '[') &&
+			(lex->peektok() != tokSpace) && (lex->peektok() != tokNewline);
+	}
 
 	std::tuple<std::unique_ptr<_ASTInlineElement>, bool> handle(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class InlineSmileyHandler : public InlineHandler {
@@ -95,9 +99,15 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return (lex->lastToken == tokSym) &&
+			(lex->lastString[0] == ':') &&
+			(lex->peektok() != tokSpace) && (lex->peektok() != tokNewline);
+	}
 
 	std::tuple<std::unique_ptr<_ASTInlineElement>, bool> handle(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class InlineCommandHandler : public InlineHandler {
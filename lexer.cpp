@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <algorithm>
+#include <climits>
+#include <cstring>
 
 using std::string;
 using std::unique_ptr;
@@ -11,77 +13,255 @@ using std::make_tuple;
 using std::move;
 using std::make_unique;
 
-Parser::Parser(string filename) {
-	input = std::ifstream(filename, std::ifstream::in);
+// ----- DispatchTable ----- \\ 
 
-	if (!input.is_open())
-		throw "File not found";
+void DispatchTable::add(size_t index, const std::string & triggers) {
+	if (triggers.empty()) {
+		other.push_back(index);
+		for (auto & e : bySym)
+			e.push_back(index);
+		return;
+	}
+	for (auto e : triggers) {
+		std::vector<size_t> & list = bySym[(unsigned char) e];
+		if (list.empty() || list.back() != index)
+			list.push_back(index);
+	}
+}
+
+// ----- Parser ----- \\ 
+
+Parser::Parser(string filename, Utf8Policy policy) : Parser(Source::open(filename), policy) {}
+
+Parser::Parser(const char * data, size_t size, Utf8Policy policy) : Parser(make_unique<BufferSource>(data, size), policy) {}
+
+Parser::Parser(unique_ptr<Source> input, Utf8Policy policy) : source(move(input)) {
+	source->setPolicy(policy);
+	_begin = _cur = _tokStart = source->data();
+	_end = _begin + source->size();
+}
+
+bool Parser::refill() {
+	size_t cur = _cur - _begin;
+	size_t tokStart = _tokStart - _begin;
+	std::uint64_t keep = offset(_tokStart);
+	keep = keep > Source::rewindWindow ? keep - Source::rewindWindow : 0;
+	keep = std::min(keep, _prevLineStart);
+
+	// Views into the current token (all of it, or the char of an escape sequence) move with it
+	const char * str = lastString.data();
+	bool currentString = _tokStart <= str && str <= _cur;
+	bool inWindow = _begin <= str && str <= _end;
+	size_t strStart = currentString ? str - _tokStart : 0;
+
+	std::uint64_t oldBase = source->base();
+	bool more = source->fill(keep);
+
+	// Window may have moved, keep pointing at the same chars
+	size_t shift = (size_t) (source->base() - oldBase);
+	_begin = source->data();
+	_end = _begin + source->size();
+	_cur = _begin + cur - shift;
+	_tokStart = _begin + tokStart - shift;
+	// Only the current token is guaranteed to survive, older views are dropped
+	if (currentString)
+		lastString = std::string_view(_tokStart + strStart, lastString.size());
+	else if (inWindow)
+		lastString = std::string_view(_cur, 0);
+	return more;
 }
 
 Token Parser::peektok(int chr) {
-	if (input.eof()) return tokEOF;
+	if (chr == EOF) return tokEOF;
 
-	if (symbols.count(chr) == 1)
+	switch (charClass[chr]) {
+	case clsSym:
 		return tokSym;
-
-	if (isdigit(chr))
+	case clsDigit:
 		return tokNumber;
-
-	switch (chr) {
-	case ' ':
+	case clsSpace:
 		return tokSpace;
-	case '\n':
+	case clsNewline:
 		return tokNewline;
 	default:
 		return tokText;
 	}
 }
 
-inline Token Parser::peektok() {
-	return peektok(_lastChar);
-}
+Token Parser::gettok() {
+	// The token after a newline is on the next line
+	if (lastToken == tokNewline) {
+		_prevLineStart = _lineStart;
+		_lineStart = offset(_tokStart) + 1;
+	}
 
-inline int Parser::peekchar() {
-	return input.peek();
-}
+	if (_tokens != nullptr)
+		return _nexttok();
 
-Token Parser::gettok() {
 	if (_lastChar == 0)
-		_lastChar = input.get();
+		_lastChar = readchar();
 
 	lastToken = peektok();
+	_tokStart = _lastChar == EOF ? _cur : _cur - 1;
+	long long value;
 
 	switch (lastToken) {
 	case tokText:
-		lastString = _lastChar;
-		while (peektok(_lastChar = input.get()) == tokText)
-			lastString += _lastChar;
+		if (charClass[_lastChar] == clsEscape) {
+			// Escape sequence, stands for the escaped char without entering any handler
+			if (escapeLength(_cur != _end || refill() ? (unsigned char) *_cur : EOF) == 2)
+				_cur++;
+			lastString = tokenText(_tokStart, _cur - _tokStart);
+			_lastChar = readchar();
+			return lastToken;
+		}
+		// Take the whole run in one go, continue if it reaches the end of the window
+		_cur = scanText(_cur, _end, charClass);
+		while (_cur == _end && refill())
+			_cur = scanText(_cur, _end, charClass);
+		lastString = std::string_view(_tokStart, _cur - _tokStart);
+		_lastChar = readchar();
 		return lastToken;
 	case tokNumber:
-		lastString = _lastChar;
-		while (isdigit(_lastChar = input.get()))
-			lastString += _lastChar;
-		if (_lastChar == '.') {
-			lastString += _lastChar;
-			_lastChar = input.get();
-		}
-		lastInt = std::stoi(lastString);
+		value = _lastChar - '0';
+		while ((_cur != _end || refill()) && '0' <= *_cur && *_cur <= '9')
+			value = std::min(value * 10 + (*_cur++ - '0'), (long long) INT_MAX);
+		if ((_cur != _end || refill()) && *_cur == '.')
+			_cur++;
+		lastString = std::string_view(_tokStart, _cur - _tokStart);
+		lastInt = (int) value;
+		_lastChar = readchar();
 		return lastToken;
 	case tokSpace:
 	case tokSym:
-		lastInt = 1;
-		lastString = _lastChar;
-		while ((_lastChar = input.get()) == lastString.front()) 
-			lastInt++;
+		_cur = scanRun(_cur, _end, _lastChar);
+		while (_cur == _end && refill())
+			_cur = scanRun(_cur, _end, _lastChar);
+		lastInt = _cur - _tokStart;
+		lastString = std::string_view(_tokStart, 1);
+		_lastChar = readchar();
+		return lastToken;
+	case tokNewline:
+		lastString = std::string_view(_tokStart, 1);
+		_lastChar = readchar(); // Consume newline
 		return lastToken;
 	default:
-		_lastChar = input.get(); // Consume current char
+		lastString = std::string_view(_tokStart, 0);
+		_lastChar = readchar(); // Consume current char
 		return lastToken;
 	}
 }
 
+void Parser::pretokenize() {
+	// Load everything, nothing is dropped as long as keep stays at base()
+	while (source->fill(source->base())) {}
+
+	size_t cur = _cur - _begin;
+	_begin = source->data();
+	_end = _begin + source->size();
+	_cur = _tokStart = _begin + cur;
+
+	_tokens = make_unique<TokenBuffer>();
+	_tokens->tokenize(_begin, _end - _begin, source->base(), charClass);
+	_tokIndex = (size_t) -1; // Next token is the first one
+}
+
+Token Parser::_nexttok() {
+	size_t i = _tokIndex + 1;
+
+	// Position of _lastChar. Raw reads through getchar() move it away from the cursor
+	std::uint64_t pos = offset(_lastChar == 0 ? _cur : _tokEnd());
+	if (i >= _tokens->size() || _tokens->offsets[i] != pos)
+		i = std::lower_bound(_tokens->offsets.begin(), _tokens->offsets.end(), pos) - _tokens->offsets.begin();
+
+	_tokIndex = i;
+	if (i >= _tokens->size()) {
+		_tokStart = _cur = _end;
+		_lastChar = EOF;
+		lastString = std::string_view(_tokStart, 0);
+		return lastToken = tokEOF;
+	}
+
+	lastToken = (Token) _tokens->kinds[i];
+	_tokStart = _begin + (_tokens->offsets[i] - source->base());
+	switch (lastToken) {
+	case tokText:
+		lastString = tokenText(_tokStart, _tokens->lengths[i]);
+		break;
+	case tokNumber:
+		lastString = std::string_view(_tokStart, _tokens->lengths[i]);
+		lastInt = _tokens->counts[i];
+		break;
+	case tokSpace:
+	case tokSym:
+		lastString = std::string_view(_tokStart, 1);
+		lastInt = _tokens->counts[i];
+		break;
+	default:
+		lastString = std::string_view(_tokStart, 1);
+		break;
+	}
+
+	// Leave _cur and _lastChar as gettok() would, so peektok() and peekchar() keep working
+	_cur = _tokStart + _tokens->lengths[i];
+	_lastChar = readchar();
+	return lastToken;
+}
+
+void Parser::indexLines() {
+	// Load everything, nothing is dropped as long as keep stays at base()
+	while (source->fill(source->base())) {}
+
+	size_t cur = _cur - _begin;
+	_begin = source->data();
+	_end = _begin + source->size();
+	_cur = _tokStart = _begin + cur;
+
+	_lines = make_unique<LineIndex>();
+	_lines->build(_begin, _end - _begin, source->base());
+	_lineNo = 0;
+}
+
+LineInfo Parser::line() {
+	if (_lines != nullptr) {
+		// Mostly still on the same or the next line
+		std::uint64_t pos = offset(_tokStart);
+		size_t i = _lineNo;
+		auto contains = [&](size_t i) {
+			return i < _lines->size() && _lines->starts[i] <= pos &&
+				(i + 1 == _lines->size() || pos < _lines->starts[i + 1]);
+		};
+		if (!contains(i) && !contains(++i))
+			i = _lines->find(pos);
+		_lineNo = i;
+		return _lines->at(i);
+	}
+
+	if (_line.start == _lineStart)
+		return _line;
+
+	// Line is scanned from the start, refill() keeps it loaded
+	size_t indent = 0;
+	int first;
+	while (true) {
+		const char * p = _begin + (size_t) (_lineStart - source->base()) + indent;
+		const char * text = scanRun(p, _end, ' ');
+		indent += text - p;
+		if (text != _end) {
+			first = (unsigned char) *text;
+			break;
+		}
+		if (!refill()) {
+			first = '\n';
+			break;
+		}
+	}
+	_line = { _lineStart, (int) indent, first };
+	return _line;
+}
+
 void Parser::getchar() {
-	_lastChar = input.get();
+	_lastChar = readchar();
 }
 
 int Parser::currchar() {
@@ -89,56 +269,271 @@ int Parser::currchar() {
 }
 
 std::string Parser::escaped(int chr) {
-	switch (chr) {
-	case '\\':
+	if (chr == EOF)
 		return "\\";
-	case '"':
-		return "\"";
-	default:
-		return "\\" + chr;
+	char seq[2] = { '\\', (char) chr };
+	if (escapeLength(chr) == 1)
+		return std::string(seq, 2);
+	return std::string(tokenText(seq, 2));
+}
+
+tuple<std::string_view, bool> Parser::readFenced(char fence, int count) {
+	// _tokStart stays on the start of the text, so refill() keeps all of it loaded
+	std::uint64_t start = offset(_tokStart);
+	std::uint64_t fenceStart = 0;
+	bool found = false;
+	_cur = _tokStart;
+
+	while (!found) {
+		const char * p = (const char *) std::memchr(_cur, fence, _end - _cur);
+		if (p == nullptr) {
+			_cur = _end;
+			if (refill())
+				continue;
+			break;
+		}
+
+		std::uint64_t run = offset(p);
+		_cur = scanRun(p + 1, _end, fence);
+		while (_cur == _end && refill())
+			_cur = scanRun(_cur, _end, fence);
+		bool lineEnd = (_cur == _end && !refill()) || *_cur == '\n';
+
+		// An odd number of backslashes in front makes the first fence char an escape sequence
+		p = _begin + (size_t) (run - source->base());
+		const char * textStart = _begin + (size_t) (start - source->base());
+		const char * b = p;
+		while (b != textStart && b[-1] == '\\')
+			b--;
+		if ((p - b) % 2 == 1)
+			p++;
+
+		if (_cur - p == count && lineEnd) {
+			fenceStart = offset(p);
+			found = true;
+		}
+	}
+
+	const char * textStart = _begin + (size_t) (start - source->base());
+	const char * textEnd = found ? _begin + (size_t) (fenceStart - source->base()) : _end;
+	std::string_view text(textStart, textEnd - textStart);
+
+	// Lines in between were never tokenized, catch up on where the current one starts
+	size_t last = text.rfind('\n');
+	if (last != std::string_view::npos) {
+		size_t prev = last == 0 ? std::string_view::npos : text.rfind('\n', last - 1);
+		_prevLineStart = prev == std::string_view::npos ? start : start + prev + 1;
+		_lineStart = start + last + 1;
+	}
+
+	if (!stableInput()) {
+		// Reading on may move the window
+		_fenced.assign(text);
+		text = _fenced;
+	}
+
+	if (!found) {
+		_tokStart = _cur = _end;
+		_lastChar = EOF;
+		lastToken = tokEOF;
+		lastString = std::string_view(_tokStart, 0);
+		return make_tuple(text, false);
 	}
+
+	_tokStart = textEnd;
+	_cur = textEnd + count;
+	lastToken = tokSym;
+	lastInt = count;
+	lastString = std::string_view(_tokStart, 1);
+	_lastChar = readchar();
+	return make_tuple(text, true);
 }
 
-void Parser::puttok() {
-	switch (lastToken) {
-		case tokNumber:
-		case tokText:
-			input.seekg(-lastString.length() - 1, std::ios_base::cur);
+std::string_view Parser::restOfLine() {
+	if (lastToken == tokEOF)
+		return std::string_view(_tokStart, 0);
+
+	// refill() keeps everything from _tokStart on, but may move it
+	size_t start = _restStart() - _tokStart;
+	size_t searched = start;
+	const char * p;
+	while ((p = (const char *) std::memchr(_tokStart + searched, '\n', _end - _tokStart - searched)) == nullptr) {
+		searched = _end - _tokStart;
+		if (!refill()) {
+			p = _end;
 			break;
-		case tokSpace:
-		case tokSym:
-			input.seekg(-lastInt - 1, std::ios_base::cur);
+		}
+	}
+	return std::string_view(_tokStart + start, p - _tokStart - start);
+}
+
+void Parser::skip(size_t count) {
+	_cur = _restStart() + count;
+	_lastChar = 0;
+	gettok();
+}
+
+bool Parser::isPlain(std::string_view str) const {
+	for (char c : str) {
+		CharClass cls = charClass[c];
+		if (cls != clsText && cls != clsDigit && cls != clsSpace)
+			return false;
+	}
+	return true;
+}
+
+Checkpoint Parser::checkpoint() const {
+	return { offset(_tokStart), offset(_cur), _lastChar, lastToken, lastInt, _tokIndex, _lineStart };
+}
+
+void Parser::restore(const Checkpoint & cp) {
+	if (cp.start < source->base())
+		throw "Checkpoint is outside of the rewind window";
+
+	_tokStart = _begin + (cp.start - source->base());
+	_cur = _begin + (cp.next - source->base());
+	_lastChar = cp.lastChar;
+	lastToken = cp.token;
+	lastInt = cp.count;
+	_tokIndex = cp.index;
+	_lineStart = cp.lineStart;
+	_prevLineStart = std::min(_prevLineStart, cp.lineStart);
+
+	switch (lastToken) {
+	case tokText:
+		lastString = tokenText(_tokStart, _tokEnd() - _tokStart);
+		break;
+	case tokNumber:
+		lastString = std::string_view(_tokStart, _tokEnd() - _tokStart);
+		break;
+	case tokEOF:
+		lastString = std::string_view(_tokStart, 0);
+		break;
+	default:
+		lastString = std::string_view(_tokStart, 1);
+		break;
+	}
+}
+
+Lexeme Parser::lexeme() const {
+	Lexeme l;
+	l.kind = lastToken;
+	l.offset = offset(_tokStart);
+	l.length = _tokEnd() - _tokStart;
+	l.count = (lastToken == tokSpace || lastToken == tokSym) ? lastInt : 1;
+	l.number = lastToken == tokNumber ? lastInt : 0;
+	return l;
+}
+
+std::tuple<std::string, bool> Parser::make_id(std::string_view str) {
+	// Never longer than str, so it is written in place instead of appended to
+	std::string id(str.size(), '\0');
+	char * out = id.data();
+	const char * p = str.data();
+	const char * end = p + str.size();
+
+	while (true) {
+		// Runs of ASCII are done 16 bytes at a time
+		p = slugAscii(p, end, out);
+		if (p == end)
 			break;
-		case tokNewline:
-		case tokEOF:
-		default:
-			input.seekg(-2, std::ios_base::cur);
+
+		// Non-ASCII, copied as whole UTF-8 sequences
+		// Latin-1 uppercase letters (U+00C0 - U+00DE without U+00D7) to lowercase
+		unsigned char next = p + 1 != end ? p[1] : 0;
+		if ((unsigned char) *p == 0xC3 && 0x80 <= next && next <= 0x9E && next != 0x97) {
+			*out++ = *p++;
+			*out++ = (char) (*p++ + 0x20);
+		}
+		else
+			*out++ = *p++;
 	}
+
+	id.resize(out - id.data());
+	return make_tuple(std::move(id), true);
+}
+
+std::string_view Parser::intern(std::string_view name) {
+	return *_names.emplace(name).first;
 }
 
-std::tuple<std::string, bool> Parser::make_id(std::string str) {
-	std::string id;
-	for (auto e : str) {
-		// Letters
-		if (65 <= e && e <= 90)
-			// Uppercase letter
-			id += e + 32;
-		if (97 <= e && e <= 122)
-			id += e;
+ModifierCommand Parser::parseCommand(std::string_view command) {
+	ModifierCommand res;
+	bool inArgs = false; // Plain words after $function are its args
+	size_t i = 0;
 
-		// Numbers
-		if (48 <= e && e <= 57)
-			id += e;
+	while (true) {
+		while (i < command.size() && command[i] == ' ')
+			i++;
+		if (i == command.size())
+			break;
 
-		// Allowed for html compatibility
-		if (e == '_' || e == '-')
-			id += e;
+		// Word up to the next space outside of quotes, quotes are dropped
+		bool quoted = command[i] == '"';
+		bool inQuote = false;
+		std::string word;
+		for (; i < command.size() && (inQuote || command[i] != ' '); i++) {
+			if (command[i] == '"')
+				inQuote = !inQuote;
+			else
+				word += command[i];
+		}
 
-		// Space convert
-		if (e == ' ')
-			id += '-';
+		char kind = quoted || word.empty() ? 0 : word[0];
+		std::string_view value = std::string_view(word).substr(kind == 0 ? 0 : 1);
+		size_t split;
+
+		switch (kind) {
+		case '#':
+			if (res.id.empty())
+				res.id = value;
+			break;
+		case '.':
+			if (!res.classes.empty())
+				break;
+			while (!value.empty()) {
+				split = std::min(value.find('.'), value.size());
+				if (split != 0)
+					res.classes.push_back(intern(value.substr(0, split)));
+				value.remove_prefix(std::min(split + 1, value.size()));
+			}
+			break;
+		case ':':
+			if (res.title.empty())
+				res.title = value;
+			break;
+		case '+':
+			split = std::min(value.find('='), value.size());
+			if (split == 0 || std::any_of(res.attributes.begin(), res.attributes.end(),
+				[&](auto & a) { return a.first == value.substr(0, split); }))
+				break;
+			res.attributes.emplace_back(value.substr(0, split), value.substr(std::min(split + 1, value.size())));
+			break;
+		case '$':
+			if (!res.function.empty() || value.empty())
+				break;
+			res.function = intern(value);
+			inArgs = true;
+			continue;
+		case '%':
+			if (res.reference.empty())
+				res.reference = value;
+			break;
+		case '>':
+			split = value.find(':');
+			if (split == std::string_view::npos || split == 0)
+				break;
+			res.styles.emplace_back(intern(value.substr(0, split)),
+				value.substr(std::min(value.find_first_not_of(' ', split + 1), value.size())));
+			break;
+		default:
+			if (inArgs)
+				res.args.push_back(word);
+			continue;
+		}
+		inArgs = false;
 	}
-	return make_tuple(id, true);
+	return res;
 }
 
 std::tuple<std::string, bool> Parser::extractText(bool allowRange, std::string delimiter) {
@@ -146,7 +541,8 @@ std::tuple<std::string, bool> Parser::extractText(bool allowRange, std::string d
 		return make_tuple("", true);
 	bool rangeStarted = false;
 	
-	puttok(); // We need to get every char, disable Token System
+	// We need to get every char, disable Token System
+	_cur = _tokStart;
 	getchar(); // Load first Char
 	
 	if (allowRange && _lastChar == '"') {
@@ -157,7 +553,7 @@ std::tuple<std::string, bool> Parser::extractText(bool allowRange, std::string d
 	std::string result;
 
 	while (true) {
-		if (_lastChar == '\n' || input.eof())
+		if (_lastChar == '\n' || _lastChar == EOF)
 			return make_tuple("", true);
 		if (!rangeStarted && delimiter.find_first_of(_lastChar) != std::string::npos) {
 			// End of Read
@@ -174,18 +570,21 @@ std::tuple<std::string, bool> Parser::extractText(bool allowRange, std::string d
 			// Escape Sequence
 			getchar(); // Consume \ 
 			result += escaped(_lastChar);
-			getchar(); // Consume escaped char
+			if (_lastChar != '\n' && _lastChar != EOF)
+				getchar(); // Consume escaped char
+			continue;
 		}
 		result += _lastChar;
+		getchar();
 	}
 
 	while (delimiter.find_first_of(_lastChar) == std::string::npos &&
-		_lastChar != '\n' && !input.eof()) {
+		_lastChar != '\n' && _lastChar != EOF) {
 		getchar();
 	}
 
 	// Next Char is delimiter or Newline or EOF
-	if (_lastChar == '\n' && input.eof())
+	if (_lastChar == '\n' && _lastChar == EOF)
 		return make_tuple("", true);
 
 	return make_tuple(result, false);
@@ -194,68 +593,98 @@ std::tuple<std::string, bool> Parser::extractText(bool allowRange, std::string d
 	//return make_tuple("", true);
 }
 
-std::tuple<std::string, bool> Parser::readUntil(std::function<bool(Parser *)> condition) {
-	if (!condition)
-		return make_tuple("", false);
-	std::string res;
+void Parser::appendLiteral(std::string & res, bool keepEscapes) {
+	// Take text literally
+	if (lastToken == tokText)
+		res += keepEscapes ? rawString() : lastString;
+	else if (lastToken == tokNumber)
+		res += lastString;
+	else
+		res.append(lastInt, lastString[0]);
+}
 
-	while (
-		(lastToken != tokNewline) &&
-		(lastToken != tokEOF) &&
-		(!condition(this))
-		) {
-		// Take text literally
-		if (lastToken == tokText || lastToken == tokNumber)
-			res += lastString;
-		else
-			res += std::string(lastInt, lastString[0]);
-		gettok(); // Consume inserted Text
+unique_ptr<ParserHandler> Parser::acquireHandler(size_t index) {
+	if (!handlerPool[index].empty()) {
+		unique_ptr<ParserHandler> handler = move(handlerPool[index].back());
+		handlerPool[index].pop_back();
+		return handler;
 	}
+	unique_ptr<ParserHandler> handler = handlerList[index]->createNew();
+	handler->prototype = index;
+	_handlerAllocations++;
+	return handler;
+}
 
-	if (lastToken == tokNewline || lastToken == tokEOF) {
-		if (lastToken == tokNewline)
-			gettok(); // Consume Newline
-		return make_tuple(res, true);
+unique_ptr<InlineHandler> Parser::acquireInlineHandler(size_t index) {
+	if (!inlineHandlerPool[index].empty()) {
+		unique_ptr<InlineHandler> handler = move(inlineHandlerPool[index].back());
+		inlineHandlerPool[index].pop_back();
+		return handler;
 	}
-	return make_tuple(res, false);
+	unique_ptr<InlineHandler> handler = inlineHandlerList[index]->createNew();
+	handler->prototype = index;
+	_handlerAllocations++;
+	return handler;
 }
 
-unique_ptr<ParserHandler> Parser::findNextHandler() {
-	for (auto & e : handlerList) {
-		if (e->canHandle(this))
-			return move(e->createNew());
+void Parser::releaseHandler(unique_ptr<ParserHandler> & handler) {
+	if (handler != nullptr && handler->reset())
+		handlerPool[handler->prototype].push_back(move(handler));
+	handler = nullptr;
+}
+
+void Parser::releaseInlineHandler(unique_ptr<InlineHandler> & handler) {
+	if (handler != nullptr && handler->reset())
+		inlineHandlerPool[handler->prototype].push_back(move(handler));
+	handler = nullptr;
+}
+
+unique_ptr<ParserHandler> Parser::findHandlerFrom(size_t first) {
+	const std::vector<size_t> & candidates = handlerDispatch.candidates(lastToken, lastString);
+	for (auto i = std::lower_bound(candidates.begin(), candidates.end(), first); i != candidates.end(); i++) {
+		if (handlerList[*i]->canHandle(this))
+			return acquireHandler(*i);
 	}
 	return nullptr;
 }
 
+unique_ptr<ParserHandler> Parser::findNextHandler() {
+	return findHandlerFrom(0);
+}
+
 unique_ptr<ParserHandler> Parser::findNextHandler(string name) {
 	auto p = handlerAlias.find(name);
 	if (p != handlerAlias.end()) {
-		return move(handlerList[p->second]->createNew());
+		return acquireHandler(p->second);
 	}
 	return nullptr;
 }
 
-unique_ptr<InlineHandler> Parser::findNextInlineHandler() {
-	for (auto & e : inlineHandlerList) {
-		if (e->canHandle(this))
-			return move(e->createNew());
+unique_ptr<InlineHandler> Parser::findInlineHandlerFrom(size_t first) {
+	const std::vector<size_t> & candidates = inlineHandlerDispatch.candidates(lastToken, lastString);
+	for (auto i = std::lower_bound(candidates.begin(), candidates.end(), first); i != candidates.end(); i++) {
+		if (inlineHandlerList[*i]->canHandle(this))
+			return acquireInlineHandler(*i);
 	}
 	return nullptr;
 }
 
+unique_ptr<InlineHandler> Parser::findNextInlineHandler() {
+	return findInlineHandlerFrom(0);
+}
+
 unique_ptr<InlineHandler> Parser::findNextInlineHandler(string name) {
 	auto p = inlineHandlerAlias.find(name);
 	if (p != inlineHandlerAlias.end()) {
 		// auto it = p->second;
-		return move(inlineHandlerList[p->second]->createNew());
+		return acquireInlineHandler(p->second);
 	}
 	return nullptr;
 }
 
 void Parser::addSymbols(std::string str) {
 	for (auto e : str)
-		symbols.insert(e);
+		charClass.set(e, clsSym);
 }
 
 bool Parser::addToDocument(unique_ptr<_ASTElement> element) {
@@ -269,8 +698,11 @@ bool Parser::addHandler(string name, unique_ptr<ParserHandler> handler) {
 	if (handlerAlias.count(name) == 1)
 		return false;
 	
-	addSymbols(handler->triggerChars());
+	std::string triggers = handler->triggerChars();
+	addSymbols(triggers);
+	handlerDispatch.add(handlerList.size(), triggers);
 	handlerList.push_back(move(handler));
+	handlerPool.emplace_back();
 	return handlerAlias.emplace(name, handlerList.size() - 1).second;
 }
 
@@ -285,8 +717,11 @@ bool Parser::addInlineHandler(string name, unique_ptr<InlineHandler> handler) {
 	if (inlineHandlerAlias.count(name) == 1)
 		return 0;
 	
-	addSymbols(handler->triggerChars());
+	std::string triggers = handler->triggerChars();
+	addSymbols(triggers);
+	inlineHandlerDispatch.add(inlineHandlerList.size(), triggers);
 	inlineHandlerList.push_back(move(handler));
+	inlineHandlerPool.emplace_back();
 	return inlineHandlerAlias.emplace(name, inlineHandlerList.size() - 1).second;
 }
 
@@ -297,61 +732,90 @@ bool Parser::addInlineHandlerAlias(std::string alias, std::string name) {
 	return inlineHandlerAlias.emplace(alias, inlineHandlerAlias[name]).second;
 }
 
-std::tuple<unique_ptr<_ASTElement>, bool> Parser::parseLine(unique_ptr<ParserHandler> & lastHandler) {
-	if (lastToken == tokEOF) {
-		if (lastHandler != nullptr) {
-			unique_ptr<_ASTElement> e = move(lastHandler->finish(this));
-			lastHandler = nullptr;
-			return make_tuple(move(e), true);
-		}
-		return make_tuple(nullptr, false);
+unique_ptr<_ASTElement> Parser::closeBlocks(size_t level) {
+	unique_ptr<_ASTElement> e;
+	while (openBlocks.size() > level) {
+		e = move(openBlocks.back()->finish(this));
+		releaseHandler(openBlocks.back());
+		openBlocks.pop_back();
+		if (openBlocks.size() > level)
+			openBlocks.back()->addChild(e);
 	}
+	return e;
+}
+
+void Parser::finishNested() {
+	unique_ptr<_ASTElement> e = closeBlocks(_blockLevel + 1);
+	openBlocks[_blockLevel]->addChild(e);
+}
+
+unique_ptr<_ASTElement> Parser::parseLine() {
+	size_t level = 0;
 
-	if (lastHandler == nullptr || !lastHandler->canHandle(this)) {
-		if (lastHandler != nullptr) {
-			// lastHandler was unexpectedly ended. Give him a chance to finish up
-			unique_ptr<_ASTElement> e = move(lastHandler->finish(this));
-			lastHandler = nullptr;
-			return make_tuple(move(e), true);
+	while (true) {
+		if (lastToken == tokEOF)
+			return closeBlocks(0);
+
+		_blockLevel = level;
+		if (level < openBlocks.size() && !openBlocks[level]->canHandle(this)) {
+			// Unexpectedly ended. Give it and everything inside a chance to finish up
+			unique_ptr<_ASTElement> e = closeBlocks(level);
+			if (level == 0)
+				return e;
+			openBlocks[level - 1]->addChild(e);
 		}
-		// Skip everything until <Newline> <!Space>
-		// while (lastToken == tokNewline) {
-		// 	gettok(); // Consume Newline
-		// 	if (lastToken == tokSpace && peektok() == tokNewline)
-		// 		gettok(); // Consume empty lines
-		// }
-
-		lastHandler = move(findNextHandler());
-
-		// No handler for current situation (e.g. end of file or invalid char combination)
-		if (lastHandler == nullptr) {
-			if (lastToken == tokEOF)
-				return make_tuple(nullptr, false);
-			// default handler
-			lastHandler = findNextHandler("H_default");
+
+		if (level == openBlocks.size()) {
+			// Blank lines never start a block, skip them without asking any handler
+			if (atLineStart() && line().blank()) {
+				while (lastToken != tokNewline && lastToken != tokEOF)
+					gettok(); // Consume spaces
+				gettok(); // Consume newline
+				return nullptr;
+			}
+
+			unique_ptr<ParserHandler> handler = level < maxBlockDepth ? findNextHandler() : nullptr;
+
+			// No handler for current situation (e.g. end of file, invalid char combination or nested too deep)
+			if (handler == nullptr) {
+				if (lastToken == tokEOF)
+					return nullptr;
+				// default handler
+				handler = findNextHandler("H_default");
+			}
+			openBlocks.push_back(move(handler));
 		}
-	}
 
-	bool finished;
-	unique_ptr<_ASTElement> element;
-	tie(element, finished) = lastHandler->handle(this);
+		bool finished;
+		unique_ptr<_ASTElement> element;
+		tie(element, finished) = openBlocks[level]->handle(this);
 
-	if (finished)
-		lastHandler = nullptr;
+		if (openBlocks[level]->isContainer()) {
+			// Prefix consumed, the rest of the line belongs to the blocks inside
+			level++;
+			continue;
+		}
 
-	return make_tuple(move(element), false);
-}
+		if (finished) {
+			releaseHandler(openBlocks[level]);
+			openBlocks.pop_back();
+		}
 
-inline unique_ptr<_ASTElement> Parser::parseLine() {
-	return move(std::get<0>(parseLine(_lastHandler)));
+		if (level == 0)
+			return element;
+		openBlocks[level - 1]->addChild(element);
+		return nullptr;
+	}
 }
 
 void Parser::createDocument() {
-	document = make_unique<ASTDocument>();
+	document = make_unique<ASTDocument>(_hugePages);
 }
 
 void Parser::parseDocument() {
 	createDocument();
+	Arena::Scope scope(document->arena());
+	_handlerAllocations = 0;
 
 	gettok(); // Loads Start of File 
 
@@ -369,11 +833,24 @@ unique_ptr<ASTDocument> & Parser::getDocument() {
 }
 
 tuple<unique_ptr<ASTInlineText>, bool> Parser::parseText(
-	bool allowLb, bool unknownAsText, bool allowInlineStyling, int symReturn) {
+	bool allowLb, bool unknownAsText, bool allowInlineStyling, int symReturn, bool keepEscapes) {
+	// Gives back this level and whatever delimiters are still open in it on every return
+	size_t depth = _inlineDepth++;
+	tuple<unique_ptr<ASTInlineText>, bool> res = _parseText(allowLb, unknownAsText, allowInlineStyling, symReturn, keepEscapes);
+	_inlineDepth = depth;
+	return res;
+}
+
+tuple<unique_ptr<ASTInlineText>, bool> Parser::_parseText(
+	bool allowLb, bool unknownAsText, bool allowInlineStyling, int symReturn, bool keepEscapes) {
 	unique_ptr<ASTInlineText> text = make_unique<ASTInlineText>();
 
+	// Delimiters opened on this level that are not closed yet, with the index of their literal in text.
+	// Only the innermost one can be closed, anything left open at the end stays literal text
+	std::vector<std::pair<int, size_t>> openDelimiters;
+
 	while (true) {
-		unique_ptr<_ASTInlineElement> e = _parseLine(allowLb);
+		unique_ptr<_ASTInlineElement> e = _parseLine(allowLb, keepEscapes);
 		if (e == nullptr) {
 			// Forced Linebreak, EOF, EOL or Sym
 			if (lastToken == tokSpace && lastInt >= 2 && peektok() == tokNewline) {
@@ -399,6 +876,18 @@ tuple<unique_ptr<ASTInlineText>, bool> Parser::parseText(
 			if (lastString.front() == symReturn)
 				return make_tuple(move(text), false);
 
+			if (!openDelimiters.empty() && openDelimiters.back().first == lastString.front()) {
+				// Closes the innermost one, its literal becomes the modification
+				size_t start = openDelimiters.back().second;
+				openDelimiters.pop_back();
+				_inlineDepth--;
+				unique_ptr<ASTInlineText> content = make_unique<ASTInlineText>();
+				content->addElements(text->takeElements(start + 1));
+				text->at(start) = make_unique<ASTTextModification>(lastString.front(), move(content));
+				gettok(); // Consume closing indicator
+				continue;
+			}
+
 			if (allowInlineStyling) {
 				unique_ptr<InlineHandler> handler = findNextInlineHandler();
 				if (handler == nullptr) {
@@ -408,9 +897,24 @@ tuple<unique_ptr<ASTInlineText>, bool> Parser::parseText(
 					e = make_unique<ASTPlainText>(lastInt, lastString.front());
 					gettok(); // Consume sym
 				}
+				else if (_inlineDepth >= maxInlineDepth) {
+					// Nested too deep, neither opened nor handled
+					releaseInlineHandler(handler);
+					e = make_unique<ASTPlainText>(lastInt, lastString.front());
+					gettok(); // Consume sym
+				}
+				else if (handler->delimiter() != 0) {
+					// Literal until a closing run replaces it
+					openDelimiters.emplace_back(handler->delimiter(), text->size());
+					_inlineDepth++;
+					releaseInlineHandler(handler);
+					e = make_unique<ASTPlainText>(lastInt, lastString.front());
+					gettok(); // Consume opening indicator
+				}
 				else {
 					// Valid handler found
 					tie(e, std::ignore) = handler->handle(this);
+					releaseInlineHandler(handler);
 				}
 			}
 			else {
@@ -427,10 +931,10 @@ tuple<unique_ptr<ASTInlineText>, bool> Parser::parseText(
 	}
 }
 
-unique_ptr<_ASTInlineElement> Parser::_parseLine(bool allowLb) {
+unique_ptr<_ASTInlineElement> Parser::_parseLine(bool allowLb, bool keepEscapes) {
 	switch (lastToken) {
 		case tokText:
-			return move(_parsePlainText());
+			return move(_parsePlainText(keepEscapes));
 		case tokSpace:
 			if (allowLb && lastToken == tokSpace && lastInt >= 2 && peektok() == tokNewline) { 
 				// Forced Linebreak (<Space> <Space> <Linebreak>)
@@ -440,7 +944,7 @@ unique_ptr<_ASTInlineElement> Parser::_parseLine(bool allowLb) {
 			}
 			else if (peektok() == tokText) {
 				// Space and then text (e.g. after inline styling)
-				return move(_parsePlainText());
+				return move(_parsePlainText(keepEscapes));
 			}
 			else if (peektok() == tokNewline) {
 				gettok(); // Consume space
@@ -455,14 +959,20 @@ unique_ptr<_ASTInlineElement> Parser::_parseLine(bool allowLb) {
 	return nullptr;
 }
 
-unique_ptr<ASTPlainText> Parser::_parsePlainText() {
-	string str = lastString;
+unique_ptr<ASTPlainText> Parser::_parsePlainText(bool keepEscapes) {
+	string str(keepEscapes ? rawString() : lastString);
 
 	gettok(); // Consume Text
 
+	// Escape sequences are tokText as well, so they join the text around them
 	while (lastToken == tokText || lastToken == tokNumber || 
 		(lastToken == tokSpace && (lastInt < 2 || peektok() != tokNewline))) {
-		str += (lastToken == tokText || lastToken == tokNumber) ? lastString : string(" ");
+		if (lastToken == tokText)
+			str += keepEscapes ? rawString() : lastString;
+		else if (lastToken == tokNumber)
+			str += lastString;
+		else
+			str += ' ';
 		gettok(); // Consume inserted Text
 	}
 
@@ -491,6 +1001,14 @@ std::unique_ptr<_ASTElement> InlineHandler::finish(Parser * lex) {
 	return nullptr;
 }
 
+bool InlineHandler::reset() {
+	return false;
+}
+
+int InlineHandler::delimiter() {
+	return 0;
+}
+
 // ----- ParserHandler ----- \\ 
 
 std::unique_ptr<ParserHandler> ParserHandler::createNew() {
@@ -512,3 +1030,14 @@ std::tuple<std::unique_ptr<_ASTElement>, bool> ParserHandler::handle(Parser * le
 std::unique_ptr<_ASTElement> ParserHandler::finish(Parser * lex) {
 	return nullptr;
 }
+
+bool ParserHandler::reset() {
+	return false;
+}
+
+bool ParserHandler::isContainer() {
+	return false;
+}
+
+void ParserHandler::addChild(std::unique_ptr<_ASTElement> &) {
+}
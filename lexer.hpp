@@ -1,80 +1,351 @@
 #pragma once
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <cstdio>
 #include <unordered_map>
-#include <tuple>
 #include <unordered_set>
-#include <functional>
+#include <tuple>
 
 #include "AST.hpp"
+#include "source.hpp"
+#include "scanner.hpp"
+#include "token.hpp"
+#include "lines.hpp"
 
-enum Token : int {
-	
-	tokEOF = -1, // End of File
-	tokText = -2, // lastString contains text
-	tokNumber = -3, // lastInt contains number, lastString contains string read (reads <Number>.)
-	tokSpace = -4, // lastString contains ' ', lastInt contains amount of spaces
-	tokNewline = -5, // Newline Character read (\n)
-	tokSym = -6, // Indicates formatting Symbol, lastString contains it, lastInt contains amount
+/*
+	Saved lexer state, see Parser::checkpoint() and Parser::restore()
+*/
+struct Checkpoint {
+	std::uint64_t start; // Source offset of the current token
+	std::uint64_t next; // Source offset of the next char to read
+	int lastChar;
+	Token token;
+	int count; // lastInt, handlers may have consumed part of a run
+	size_t index; // Token index if pretokenized
+	std::uint64_t lineStart; // Source offset of the line the token is on
 };
 
 class ParserHandler;
 class InlineHandler;
 
+/*
+	Which handlers to ask for the current token, in the order they were added.
+	A handler with trigger chars is only asked on a tokSym of one of them,
+	a handler without any is asked on every token
+*/
+class DispatchTable {
+protected:
+
+	std::vector<size_t> bySym[256];
+	std::vector<size_t> other;
+
+public:
+
+	/*
+		@param index Position of the handler in its handler list
+		@param triggers Its triggerChars()
+	*/
+	void add(size_t index, const std::string & triggers);
+
+	const std::vector<size_t> & candidates(Token token, std::string_view str) const {
+		return token == tokSym ? bySym[(unsigned char) str[0]] : other;
+	}
+};
+
 /*
 	Wrapper class for creating an AST
 */
 class Parser {
 protected:
-	std::ifstream input;
+	std::unique_ptr<Source> source;
+
+	// Loaded window of source, next char to read and end of window
+	const char * _begin = nullptr;
+	const char * _cur = nullptr;
+	const char * _end = nullptr;
+
+	// First char of the current token
+	const char * _tokStart = nullptr;
+
+	// Set by pretokenize(), gettok() then walks these instead of the source
+	std::unique_ptr<TokenBuffer> _tokens = nullptr;
+	size_t _tokIndex = 0;
+
+	Token _nexttok();
+
+	// Handlers roll back at most into the previous line, refill() keeps both
+	std::uint64_t _lineStart = 0;
+	std::uint64_t _prevLineStart = 0;
+
+	// Set by indexLines(), line() then looks lines up instead of scanning them
+	std::unique_ptr<LineIndex> _lines = nullptr;
+	size_t _lineNo = 0;
+
+	// Last line scanned by line() without an index
+	LineInfo _line = { UINT64_MAX, 0, 0 };
 
 	std::unordered_map<std::string, size_t> handlerAlias;
 	std::vector<std::unique_ptr<ParserHandler>> handlerList;
+	DispatchTable handlerDispatch;
 
-	std::unordered_set<int> symbols;
+	CharClassTable charClass;
 
 	std::unordered_map<std::string, size_t> inlineHandlerAlias;
 	std::vector<std::unique_ptr<InlineHandler>> inlineHandlerList;
+	DispatchTable inlineHandlerDispatch;
+
+	// Finished handlers waiting to be reused, one list per registered handler
+	std::vector<std::vector<std::unique_ptr<ParserHandler>>> handlerPool;
+	std::vector<std::vector<std::unique_ptr<InlineHandler>>> inlineHandlerPool;
+	size_t _handlerAllocations = 0;
+
+	// Whether documents take their Arena from huge pages, see useHugePages()
+	bool _hugePages = false;
+
+	std::unique_ptr<ParserHandler> acquireHandler(size_t index);
+	std::unique_ptr<InlineHandler> acquireInlineHandler(size_t index);
+
+	// Same as findNextHandler(), but only asks handlers added as number first or later
+	std::unique_ptr<ParserHandler> findHandlerFrom(size_t first);
+	std::unique_ptr<InlineHandler> findInlineHandlerFrom(size_t first);
+
+	// Blocks open on the current line, outermost first. Each container is followed by the block inside it
+	std::vector<std::unique_ptr<ParserHandler>> openBlocks;
+
+	// Position in openBlocks of the block being handled
+	size_t _blockLevel = 0;
+
+	// Inline nesting of the parseText() calls running and their open delimiters, see maxInlineDepth
+	size_t _inlineDepth = 0;
+
+	std::tuple<std::unique_ptr<ASTInlineText>, bool> _parseText(
+		bool allowLb, bool unknownAsText, bool allowInlineStyling, int symReturn, bool keepEscapes);
+
+	// Text of the last readFenced() if the input can move
+	std::string _fenced;
+
+	// Names handed out by intern(). Nodes are never moved, so views of them stay valid
+	std::unordered_set<std::string> _names;
 
-	std::unique_ptr<ParserHandler> _lastHandler = nullptr;
 	std::unique_ptr<ASTDocument> document = nullptr;
 
 	int _lastChar = 0;
 
-	std::unique_ptr<ASTPlainText> _parsePlainText();
-	std::unique_ptr<_ASTInlineElement> _parseLine(bool allowLb = true);
+	/*
+		Loads more input once the window is used up. Keeps the current and previous line,
+		the current token and Source::rewindWindow bytes before it
+		@return false on end of input
+	*/
+	bool refill();
+
+	// Same as std::istream::get(): next char as unsigned char or EOF
+	int readchar() {
+		if (_cur == _end && !refill())
+			return EOF;
+		return (unsigned char) *_cur++;
+	}
 
-	void puttok();
+	// End of the current token, where _lastChar was read from
+	const char * _tokEnd() const {
+		return _lastChar == EOF ? _cur : _cur - 1;
+	}
+
+	// Absolute source offset of p
+	std::uint64_t offset(const char * p) const {
+		return source->base() + (p - _begin);
+	}
+
+	// Start of restOfLine()
+	const char * _restStart() const {
+		return lastToken == tokSym || lastToken == tokSpace ? _tokEnd() - lastInt : _tokStart;
+	}
+
+	std::unique_ptr<ASTPlainText> _parsePlainText(bool keepEscapes = false);
+	std::unique_ptr<_ASTInlineElement> _parseLine(bool allowLb = true, bool keepEscapes = false);
+
+	/*
+		Finishes the blocks open from level on, innermost first. Each one is added to the container around it
+		@return Element of the block at level, nullptr if there is none
+	*/
+	std::unique_ptr<_ASTElement> closeBlocks(size_t level);
 
 	void addSymbols(std::string str);
 
 public:
 
-	std::string lastString;
+	// View of the current token in the source window, valid until the next gettok()/restore()
+	std::string_view lastString;
 	int lastInt;
-	Token lastToken;
+	Token lastToken = tokEOF;
+
+
+	/*
+		@param filename File to parse, "-" reads stdin
+		@param policy What to do with invalid UTF-8 in the input
+	*/
+	Parser(std::string filename, Utf8Policy policy = Utf8Policy::pass);
 
+	/*
+		Parses memory owned by the caller. Nothing is copied unless invalid UTF-8 is replaced,
+		data has to outlive the Parser
+		@param data Start of input
+		@param size Length of input in bytes
+		@param policy What to do with invalid UTF-8 in the input
+	*/
+	Parser(const char * data, size_t size, Utf8Policy policy = Utf8Policy::pass);
 
-	Parser(std::string filename);
-	~Parser() = default;
+	Parser(std::unique_ptr<Source> input, Utf8Policy policy = Utf8Policy::pass);
+	virtual ~Parser() = default;
 
 	Token peektok(int chr);
-	Token peektok();
 
-	int peekchar();
+	Token peektok() {
+		return peektok(_lastChar);
+	}
+
+	int peekchar() {
+		if (_cur == _end && !refill())
+			return EOF;
+		return (unsigned char) *_cur;
+	}
 
 	Token gettok();
 	void getchar();
 	int currchar();
 
+	/*
+		@return The current token as a span of the source
+	*/
+	Lexeme lexeme() const;
+
+	/*
+		@return The current token as written in the source. Differs from lastString only for
+		escape sequences, which keep their backslash
+	*/
+	std::string_view rawString() const {
+		return lastToken == tokText ? std::string_view(_tokStart, _tokEnd() - _tokStart) : lastString;
+	}
+
+	/*
+		Optional first pass: tokenizes the whole input into a TokenBuffer, gettok() afterwards
+		only moves a cursor over it. Call after all handlers are added and before parsing.
+		Chunked sources are read into memory completely
+	*/
+	void pretokenize();
+
+	/*
+		Optional first pass: indexes start, indentation and first char of every line.
+		Call before parsing. Chunked sources are read into memory completely
+	*/
+	void indexLines();
+
+	/*
+		Optional: the next documents take the memory of their nodes in huge pages where the
+		system has them, fewer TLB misses on large inputs. Call before parseDocument()
+	*/
+	void useHugePages(bool enable = true) {
+		_hugePages = enable;
+	}
+
+	/*
+		@return Lines of indexLines(), nullptr if it was not called
+	*/
+	const LineIndex * lines() const {
+		return _lines.get();
+	}
+
+	/*
+		@return Indentation and first char of the line the current token is on.
+		A lookup if indexLines() was called, otherwise the line is scanned once
+	*/
+	LineInfo line();
+
+	/*
+		@return Whether the current token is the first one of its line
+	*/
+	bool atLineStart() {
+		return offset(_tokStart) == line().start;
+	}
+
+	/*
+		@return Whether views into the input stay valid as long as the Parser does (see Source::stable())
+	*/
+	bool stableInput() const {
+		return source->stable();
+	}
+
+	/*
+		Skips raw input up to the next run of exactly count fence chars that ends its line,
+		without tokenizing anything in between. Runs are found with memchr, escaped fence chars
+		are respected like gettok() would. Starts at the current token
+		@return Text up to the fence (or EOF) and whether the fence was found. The Parser is left
+		on the fence, or on EOF. The view is into the input, or into a copy held until the next call
+		if stableInput() is false
+	*/
+	std::tuple<std::string_view, bool> readFenced(char fence, int count);
+
+	/*
+		@return Raw input from the current token (what is left of it, if a handler consumed part of a run)
+		up to the end of its line, without the newline. Valid until the next gettok()
+	*/
+	std::string_view restOfLine();
+
+	/*
+		Moves on by count chars of restOfLine() without tokenizing them, then reads the next token.
+		Stays on the line, count has to end on a token boundary like the start of a sym
+	*/
+	void skip(size_t count);
+
+	/*
+		@return Whether str is nothing but text, digits and spaces, so parseText() would return it unchanged
+	*/
+	bool isPlain(std::string_view str) const;
+
+	/*
+		@return Tokens of pretokenize(), nullptr if it was not called
+	*/
+	const TokenBuffer * tokens() const {
+		return _tokens.get();
+	}
+
+	/*
+		Saves the current lexer state. Any number of tokens can be read before restoring it,
+		neither saving nor restoring touches the input
+	*/
+	Checkpoint checkpoint() const;
+
+	/*
+		Puts the lexer back on the token it was on when cp was created
+	*/
+	void restore(const Checkpoint & cp);
+
+	/*
+		@param chr Char following a backslash
+		@return What the escape sequence stands for, backslash and chr if it is none
+	*/
 	std::string escaped(int chr);
 
 	/*
-		Turns str into a valid id. This includes converting to lowercase, replacing space with '-'
+		Turns str into a valid id. This includes converting to lowercase, replacing space with '-'.
+		Non-ASCII characters are kept as UTF-8, Latin-1 uppercase letters are lowercased
 		@param str String to convert
 		@result the idified string, and whether it was successful. Returns empty string on unsuccessful
 	*/
-	std::tuple<std::string, bool> make_id(std::string str);
+	std::tuple<std::string, bool> make_id(std::string_view str);
+
+	/*
+		@return View of a copy of name held by the Parser, the same one for equal names
+	*/
+	std::string_view intern(std::string_view name);
+
+	/*
+		Decodes the command of a modifier, e.g. the part in {} of [text]{#id .a.b :"title" +n=v $func args >name:value %name}.
+		Words are separated by spaces outside of quotes. id, classes, title and function count once,
+		later ones are ignored, like attributes with a name already set. Unknown words are dropped
+		@param command Command as read, escape sequences decoded
+		@return Its parts. Class, function and style names are interned
+	*/
+	ModifierCommand parseCommand(std::string_view command);
 
 	/*
 		@param allowRange Whether delimiter is allowed if in ""
@@ -86,17 +357,56 @@ public:
 	/*
 		Reads Text literally (no Sym or Space collapsing) until condition is met or EOF/EOL occured
 		Doesnt consume ending token if condition caused end, does consume newline
-		@param condition returns true if reading should end
+		@param condition Callable bool(Parser *), returns true if reading should end. Taken as a
+		template so lambdas and stateful predicates are called directly, without std::function
+		@param keepEscapes Whether escape sequences are kept as written instead of decoded
 		@return String read and whether it ended on EOF/EOL (=true) or condition (=false)
 	*/
-	std::tuple<std::string, bool> readUntil(std::function<bool(Parser *)> condition);
+	template<class Condition>
+	std::tuple<std::string, bool> readUntil(Condition condition, bool keepEscapes = false) {
+		std::string res;
+
+		while (
+			(lastToken != tokNewline) &&
+			(lastToken != tokEOF) &&
+			(!condition(this))
+			) {
+			appendLiteral(res, keepEscapes);
+			gettok(); // Consume inserted Text
+		}
+
+		if (lastToken == tokNewline || lastToken == tokEOF) {
+			if (lastToken == tokNewline)
+				gettok(); // Consume Newline
+			return std::make_tuple(std::move(res), true);
+		}
+		return std::make_tuple(std::move(res), false);
+	}
+
+	// Appends the current token to res as written, used by readUntil
+	void appendLiteral(std::string & res, bool keepEscapes);
 
-	std::unique_ptr<ParserHandler> findNextHandler();
+	// Virtual so StaticParser can dispatch at compile time
+	virtual std::unique_ptr<ParserHandler> findNextHandler();
 	std::unique_ptr<ParserHandler> findNextHandler(std::string name);
 
-	std::unique_ptr<InlineHandler> findNextInlineHandler();
+	virtual std::unique_ptr<InlineHandler> findNextInlineHandler();
 	std::unique_ptr<InlineHandler> findNextInlineHandler(std::string name);
 
+	/*
+		Hands a finished handler back for reuse by findNextHandler(). handler is nullptr afterwards.
+		Handlers whose reset() returns false are destroyed instead
+	*/
+	void releaseHandler(std::unique_ptr<ParserHandler> & handler);
+	void releaseInlineHandler(std::unique_ptr<InlineHandler> & handler);
+
+	/*
+		@return Handlers created through createNew() during the last parseDocument(), reused ones are not counted
+	*/
+	size_t handlerAllocations() const {
+		return _handlerAllocations;
+	}
+
 	bool addToDocument(std::unique_ptr<_ASTElement> element);
 
 	/*
@@ -105,10 +415,12 @@ public:
 		@param allowInlineStyling Whether other inline styling elements are allowed. Printed as literal text
 		@param inlineSymReturn Returns if this Inline-Sym occures
 		@param symReturn Returns if this Sym occures
+		@param keepEscapes Whether escape sequences are kept as written instead of decoded, e.g. for code
 		@returns If second parameter is true, it ended on linebreak. If False it ended on symReturn or unknown Symbol (Only if unknownAsText == false)
 	*/
 	std::tuple<std::unique_ptr<ASTInlineText>, bool> parseText(
-		bool allowLb = true, bool unknownAsText = true, bool allowInlineStyling = true, int symReturn = 0);
+		bool allowLb = true, bool unknownAsText = true, bool allowInlineStyling = true, int symReturn = 0,
+		bool keepEscapes = false);
 
 	// std::tuple<std::unique_ptr<ASTInlineText>, bool> parseText(allowLb, unknownAsText, allowInlineStyling, inlineSymReturn, symReturn)
 
@@ -128,15 +440,45 @@ public:
 	bool addInlineHandler(std::string name, std::unique_ptr<InlineHandler> handler);
 	bool addInlineHandlerAlias(std::string alias, std::string name);
 
+	// Deepest blocks can be nested. Lines below are left to H_default, so input can not nest without bound
+	static const size_t maxBlockDepth = 64;
+
 	/*
-		Has consumed newline if second return value is true.
-		@returns unique_ptr : Element to insert or nullptr. bool : Whether the current Handler was finished.
+		How deep inline elements nest, counting open delimiters like * and handlers that parse text
+		themselves like [...]. Deeper openers stay literal text, so hostile input can not exhaust the stack
+	*/
+	static const size_t maxInlineDepth = 64;
+
+	/*
+		Parses one line. Open blocks are matched against it outermost first, each container consumes
+		its prefix of the line (e.g. "> ") and the rest goes to the blocks inside it. The first one that
+		does not continue is finished together with everything inside it
+		@returns Element of an outermost block that was finished, to insert into the document. nullptr if none was
 	*/
-	std::tuple<std::unique_ptr<_ASTElement>, bool> parseLine(std::unique_ptr<ParserHandler> & lastHandler);
 	std::unique_ptr<_ASTElement> parseLine();
 
+	/*
+		For containers only. Finishes every block open inside the one being handled and adds them to it,
+		e.g. before a list starts its next item
+	*/
+	void finishNested();
+
+	/*
+		@return How many containers are around the block being handled. 0 if its lines reach it unchanged
+	*/
+	size_t blockLevel() const {
+		return _blockLevel;
+	}
+
 	void createDocument();
+
+	/*
+		Parses the whole input into a new document. Every node is allocated from the Arena
+		of the document, so they are released at once when it is dropped
+	*/
 	void parseDocument();
+
+	// Code blocks refer into the input if stableInput(), keep the Parser alive as long as the document
 	std::unique_ptr<ASTDocument> & getDocument();
 
 	void addDefaultHandlers();
@@ -148,6 +490,10 @@ public:
 */
 class InlineHandler {
 protected:
+	friend class Parser;
+
+	// Index of the registered handler this one was created from
+	size_t prototype = 0;
 
 public:
 
@@ -164,6 +510,20 @@ public:
 	virtual std::tuple<std::unique_ptr<_ASTInlineElement>, bool> handle(Parser * lex);
 
 	virtual std::unique_ptr<_ASTElement> finish(Parser * lex);
+
+	/*
+		Puts the handler back into the state createNew() returns, so it can be reused.
+		Keep buffers allocated where possible
+		@return Whether the handler can be reused. Handlers that do not override this never are
+	*/
+	virtual bool reset();
+
+	/*
+		Symbol this handler pairs up, e.g. '*' for *bold*. parseText() then matches the runs
+		on a delimiter stack instead of calling handle(), which needs no recursion for nesting
+		@return 0 if handle() parses the element
+	*/
+	virtual int delimiter();
 };
 
 /*
@@ -171,6 +531,10 @@ public:
 */
 class ParserHandler {
 protected:
+	friend class Parser;
+
+	// Index of the registered handler this one was created from
+	size_t prototype = 0;
 
 public:
 
@@ -187,4 +551,20 @@ public:
 	virtual std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex);
 
 	virtual std::unique_ptr<_ASTElement> finish(Parser * lex);
+
+	/*
+		Puts the handler back into the state createNew() returns, so it can be reused.
+		Keep buffers allocated where possible
+		@return Whether the handler can be reused. Handlers that do not override this never are
+	*/
+	virtual bool reset();
+
+	/*
+		Whether this block holds other blocks, like BlockHandler. Its handle() then only consumes
+		its prefix of the line, Parser::parseLine() goes on with the blocks inside it
+	*/
+	virtual bool isContainer();
+
+	// For containers only. Adds the element of a block inside it
+	virtual void addChild(std::unique_ptr<_ASTElement> & element);
 };
@@ -0,0 +1,42 @@
+#include "lines.hpp"
+#include "scanner.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+size_t LineIndex::find(std::uint64_t offset) const {
+	size_t i = std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin();
+	return i == 0 ? 0 : i - 1;
+}
+
+std::tuple<size_t, size_t> LineIndex::position(std::uint64_t offset) const {
+	size_t i = find(offset);
+	return std::make_tuple(i + 1, (size_t) (offset - starts[i]) + 1);
+}
+
+void LineIndex::build(const char * data, size_t size, std::uint64_t base) {
+	starts.clear();
+	indents.clear();
+	firsts.clear();
+
+	// Prose lines are mostly longer than 40 chars
+	size_t expected = size / 40 + 1;
+	starts.reserve(expected);
+	indents.reserve(expected);
+	firsts.reserve(expected);
+
+	const char * p = data;
+	const char * end = data + size;
+	while (true) {
+		const char * text = scanRun(p, end, ' ');
+		starts.push_back(base + (p - data));
+		indents.push_back((std::uint32_t) std::min<size_t>(text - p, UINT32_MAX));
+		firsts.push_back(text == end ? '\n' : *text);
+
+		const char * nl = text == end ? nullptr : (const char *) std::memchr(text, '\n', end - text);
+		if (nl == nullptr)
+			break;
+		p = nl + 1;
+	}
+}
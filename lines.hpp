@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <tuple>
+#include <cstdint>
+#include <cstddef>
+
+/*
+	Block structure of one line, see Parser::line()
+*/
+struct LineInfo {
+	std::uint64_t start; // Source offset of the first char
+	int indent; // Leading spaces
+	int first; // First char after the indentation, '\n' for blank lines (also at end of input)
+
+	bool blank() const {
+		return first == '\n';
+	}
+};
+
+/*
+	Every line of the input, stored as one array per field. A line starts at
+	offset 0 and after every '\n', so there is always one more line than newlines.
+	Newlines are found with memchr, indentation with scanRun()
+*/
+class LineIndex {
+public:
+
+	std::vector<std::uint64_t> starts; // Source offset of the first char
+	std::vector<std::uint32_t> indents; // Leading spaces
+	std::vector<unsigned char> firsts; // First char after the indentation, '\n' if blank
+
+	size_t size() const {
+		return starts.size();
+	}
+
+	LineInfo at(size_t i) const {
+		return { starts[i], (int) indents[i], firsts[i] };
+	}
+
+	/*
+		@return Line containing the char at offset
+	*/
+	size_t find(std::uint64_t offset) const;
+
+	/*
+		@return 1-based line and column of the char at offset, e.g. for error messages
+	*/
+	std::tuple<size_t, size_t> position(std::uint64_t offset) const;
+
+	/*
+		Replaces the content with the lines of [data, data + size)
+		@param base Source offset of data
+	*/
+	void build(const char * data, size_t size, std::uint64_t base);
+};
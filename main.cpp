@@ -1,8 +1,10 @@
 #include <iostream>
+#include <fstream>
 
 #include "lexer.hpp"
 #include "parser_handler.hpp"
 #include "inline_handler.hpp"
+#include "static_parser.hpp"
 
 /*
 *	--- Adding handlers ---
@@ -20,7 +22,9 @@
 ?	- createNew() : To return a new unique_ptr instance of your class. Typically:
 	  > return std::make_unique<clasName>();
 ?	- triggerChars() : To return a std::string of chars to listen for. If none are specified,
-	  they are treated as text and thus parsed as (part of) a paragraph
+	  they are treated as text and thus parsed as (part of) a paragraph.
+	  canHandle() is then only called on a tokSym of one of these chars. Without trigger chars
+	  it is called on every token, so only leave them empty if the handler starts on text
 ?	- canHandle(Parser * lex) : Is called to determine whether your Handler applies to the 
 	  current situation. Returns a bool. Shall always return fals on tokEOF. You shall not modify 
 	  the parser object although you can for functionality reasons.
@@ -36,7 +40,18 @@
 ?	- finish(Parser * lex) : Is called if next Line is not parsable (canHandle() == false),
 	  but handler is not finished (last handle() was { - , false }). Returns unique pointer 
 	  holding ASTElement to insert.
-	
+?	- reset() : Optional. Puts the handler back into the state createNew() returns and returns true,
+	  the Parser then reuses it instead of calling createNew() again. Keep buffers allocated.
+	  Not overriding it (returns false) is always safe, the handler is then never reused
+?	- isContainer() / addChild(element) : Optional, ParserHandler only. For blocks holding other blocks
+	  like BlockHandler (parser_handler.hpp). handle() then only consumes the prefix of the line
+	  (e.g. "> "), the Parser continues with the blocks open inside and passes their elements to
+	  addChild(). Nesting is capped at Parser::maxBlockDepth, deeper lines go to H_default
+?	- delimiter() : Optional, InlineHandler only. Returns the symbol of paired runs like *bold*.
+	  parseText() then matches opening and closing runs on a stack and never calls handle(),
+	  so nesting needs no recursion. Only the innermost open run can be closed. Inline nesting is capped
+	  at Parser::maxInlineDepth, deeper runs and handlers stay literal text
+
 ?	Useful members for Parsing (all regarding Parser object):
 ?	Functions:
 	- peektok() : Looks for the next token
@@ -46,13 +61,35 @@
 	- parseText(bool, bool, int) : 
 	  Returns a tuple { unique_ptr , bool } with the text line, applying inline-styling.
 	  See its documentation for more information about return values and parameters.
-	- parseLine(ParserHandler &) : Parses a line of input, looks for ParserHandler to apply
-	  and appliey them, returns result. Useful for blocks that should otherwise behave like normal
-	  syntax
+	- parseLine() : Parses a line of input through the stack of open blocks, looks for ParserHandler
+	  to apply and applies them, returns result
+	- finishNested() : For containers, finishes every block open inside the one being handled,
+	  e.g. before a list starts its next item
+	- blockLevel() : How many containers are around the block being handled
+	- readFenced(fence, count) : Skips raw input up to a closing fence without tokenizing it,
+	  returns the text in between. Only use it with blockLevel() == 0, containers strip prefixes
+	  from every line. The text refers into the input if stableInput(), otherwise copy it
+	- restOfLine() / skip(count) : The raw rest of the current line, and moving past part of it without
+	  tokenizing it. isPlain() tells whether a span needs parseText() at all
+	- parseCommand(command) : Decodes a command like {#id .class :"title"} into a ModifierCommand (AST.hpp).
+	  Names it contains are interned, intern() does the same for any other string
+	- checkpoint() / restore(Checkpoint) : Saves the lexer state and rolls back to it later,
+	  e.g. if a speculatively parsed element turns out invalid
+	- lexeme() : The current token as kind, source offset, length, run count and number
+	- rawString() : The current token as written in the source. Escape sequences (\* etc.) are
+	  tokText and lastString holds the escaped char, rawString() keeps the backslash
+	- pretokenize() : Optional, tokenizes the whole input up front. Call before parseDocument()
+	- handlerAllocations() : How many handlers the last parseDocument() had to create through createNew()
+	- indexLines() : Optional, indexes every line up front. Call before parseDocument()
+	- useHugePages() : Optional, the nodes of a document all live in its Arena (arena.hpp) and are released
+	  with it at once. This takes that memory in huge pages. Call before parseDocument()
+	- line() : Start, indentation and first char after it of the current line. blank() if there
+	  is nothing but spaces. atLineStart() tells whether the current token is the first one on it
 
 ?	Variables:
 	- lastToken : Holds the current token
-	- lastString : Holds information for the current Token. See enum Token for more information
+	- lastString : Holds information for the current Token. See enum Token for more information.
+	  It is a view into the input, copy it if it has to outlive the next gettok()
 	- lastInt : Holds counting information for the current token. See enum Token for more information
 
 *	--- Applying Handlers ---
@@ -66,45 +103,33 @@
 
 ?	If no valid Handler is found but EOF is not reached, H_default is called.
 
-	addDefaultHandlers() adds all sorts of handlers that are considered default:
+	addDefaultHandlers() adds all sorts of handlers that are considered default.
+	DefaultParser (static_parser.hpp) has the same set built in, StaticParser<Handlers...>
+	takes any other fixed set and dispatches it without virtual calls:
 	(Work in Progress)
 	H_paragraph (H_default) : Parses paragraphs of text, ending on a empty line
-	H_heading : Parses Headings of Syntax "#"(1x-6x) <Space> <Text> <Newline>
+	H_heading : Parses Headings of Syntax "#"(1x-6x) <Space> <Text> <Newline>. Adds them to the table of contents
+	  of the document (getDocument()->toc()) unless they hold a []{$no_toc}, []{$insert_toc} shows it.
+	  Ids are unique, getDocument()->anchors() appends -1, -2 and so on to repeated ones. [text]#() and
+	  (#id) links refer to them like to definitions of H_reference
+	H_code : Parses code fenced by "```" <lang>. Blocks in a language of highlight.cpp (C/C++, Python, shell, JSON)
+	  carry token spans in their JSON, HighlightCache::shared() tokenizes repeated code only once
+	H_table : Parses rows of Syntax "|" <Text> ("|" <Text>)* <Newline>, a second row of "--", ":--", "--:"
+	  or ":-:" cells sets alignments and makes the first one the header
+	H_reference : Parses definitions of Syntax "%(" <name> "):" <url> <command>, "%{" <name> "}:" <command>,
+	  "%<" <name> ">:" <Text> and "^" <id> ":" <Text>. They fill in the references of the document
+	  (getDocument()->references()), which modifiers point to whether they come before or after them
 
 	I_bold : Prints text of Syntax "*" <Text> "*" as bold text
 	I_italic : Prints text of Syntax "/" <Text> "/" as italic text
+	I_emoji : Prints emoji of Syntax ":" <shortcode> ":" for shortcodes in the table of emoji.cpp,
+	  anything else stays text
 */
 
 int main(int argc, char *argv[]) {
-	Parser parser("example.nd");
-
-	// Comment for git testing
-
-	parser.addHandler<UnorderedListHandler>("H_ulist");
-	parser.addHandler<OrderedListHandler>("H_olist");
-	parser.addHandler<HeadingHandler>("H_heading");
-	parser.addHandler<BlockquoteHandler>("H_blockquote");
-	parser.addHandler<HLineHandler>("H_hline");
-	parser.addHandler<CodeHandler>("H_code");
-	
-
-	parser.addInlineHandler<InlineTemplateHandler<'*'>>("I_bold");
-	parser.addInlineHandler<InlineTemplateHandler<'/'>>("I_italic");
-	parser.addInlineHandler<InlineTemplateHandler<'_'>>("I_underlined");
-	parser.addInlineHandler<InlineTemplateHandler<'~'>>("I_strikethrough");
-	parser.addInlineHandler<InlineTemplateHandler<'='>>("I_highlight");
-
-	parser.addInlineHandler<InlineSmileyHandler>("I_emoji");
-
-	parser.addInlineHandler<InlineCodeHandler>("I_code");
-
-	parser.addInlineHandler<InlineModifierHandler>("I_link");
-
-
-	parser.addHandler<ParagraphHandler>("H_paragraph");
-	parser.addHandlerAlias("H_default", "H_paragraph");
-
-
+	// Input file as first argument, "-" reads stdin
+	// Same handlers as addDefaultHandlers(), dispatched at compile time (see static_parser.hpp)
+	DefaultParser parser(argc > 1 ? argv[1] : "example.nd");
 
 	parser.parseDocument();
 
@@ -1,45 +1,68 @@
 #pragma once
 #include "lexer.hpp"
 
+/*
+	Spaces in front of the current token. Lines that reach the handler unchanged (blockLevel() 0)
+	are looked up in the line table, inside containers part of them may already be consumed
+*/
+inline int indentation(Parser * lex) {
+	return lex->blockLevel() == 0 ? lex->line().indent : lex->lastInt;
+}
+
+/*
+	First char of the current token if it is a tokSym, 0 otherwise. Taken from the line table
+	for lines that reach the handler unchanged, the token is the first one of its line then
+*/
+inline int firstSym(Parser * lex) {
+	if (lex->lastToken != tokSym)
+		return 0;
+	return lex->blockLevel() == 0 ? lex->line().first : (unsigned char) lex->lastString[0];
+}
+
+/*
+	Block holding other blocks. handle() only consumes the prefix of each line it continues,
+	Parser::parseLine() hands the rest to the blocks open inside it
+*/
 template<class cl>
 class BlockHandler : public ParserHandler {
 protected:
 
 	std::unique_ptr<cl> content = nullptr;
-	std::unique_ptr<ParserHandler> handler = nullptr;
 	int indentLevel = 0;
 
 	bool canHandleBlock(Parser * lex) {
 		return (content != nullptr) &&
 			(lex->lastToken == tokSpace) &&
-			(indentLevel == 0 || lex->lastInt >= indentLevel);
+			(indentLevel == 0 || indentation(lex) >= indentLevel);
 	}
 
 	void handleBlock(Parser * lex) {
+		int indent = indentation(lex);
 		if (indentLevel == 0)
-			indentLevel = lex->lastInt;
+			indentLevel = indent;
 
-		if (indentLevel == lex->lastInt)
+		if (indentLevel == indent)
 			lex->gettok();
 		else
 			lex->lastInt -= indentLevel;
+	}
+
+public:
 
-		std::unique_ptr<_ASTElement> e;
-		bool redo;
-		do {
-			std::tie(e, redo) = lex->parseLine(handler);
-			content->addElement(e);
-		} while (redo);
+	bool reset() override {
+		content = nullptr;
+		indentLevel = 0;
+		return true;
 	}
 
-	void finishBlock(Parser * lex) {
-		if (handler != nullptr && content != nullptr) {
-			std::unique_ptr<_ASTElement> e = std::move(handler->finish(lex));
-			content->addElement(e);
-		}
+	bool isContainer() override {
+		return true;
 	}
 
-public:
+	void addChild(std::unique_ptr<_ASTElement> & element) override {
+		if (content != nullptr)
+			content->addElement(element);
+	}
 
 };
 
@@ -54,11 +77,17 @@ public:
 
 	std::unique_ptr<ParserHandler> createNew() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return 
+			(lex->lastToken == tokSpace) || 
+			(lex->lastToken == tokText);
+	}
 
 	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class HeadingHandler : public ParserHandler {
@@ -70,11 +99,18 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return (lex->lastToken == tokSym) && 
+			(lex->lastString[0] == '#') &&
+			(lex->lastInt <= 6) &&
+			(lex->peektok() == tokSpace || lex->peektok() == tokNewline);
+	}
 
 	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class HLineHandler : public ParserHandler {
@@ -86,11 +122,18 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return (lex->lastToken == tokSym) && 
+			(lex->lastString[0] == '-') &&
+			(lex->lastInt >= 3) &&
+			(lex->peektok() == tokNewline);
+	}
 
 	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class BlockquoteHandler : public BlockHandler<ASTBlockquote> {
@@ -107,11 +150,24 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		if (content != nullptr)
+			return (canHandleBlock(lex) && (indentStyle == ' ' || indentStyle == 0)) ||
+				(indentStyle == '>' || indentStyle == 0) &&
+				((firstSym(lex) == '>') && 
+				(lex->lastInt == (centered ? 2 : 1)) && 
+				(lex->peektok() == tokSpace || lex->peektok() == tokNewline));
+
+		return (firstSym(lex) == '>') && 
+			(lex->lastInt <= 2) && 
+			(lex->peektok() == tokSpace || lex->peektok() == tokNewline);
+	}
 
 	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class UnorderedListHandler : public BlockHandler<ASTListElement> {
@@ -125,11 +181,18 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return canHandleBlock(lex) ||
+			((firstSym(lex) == '-') && 
+			(lex->lastInt == 1) && 
+			(lex->peektok() == tokSpace || lex->peektok() == tokNewline));
+	}
 
 	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class OrderedListHandler : public BlockHandler<ASTListElement> {
@@ -143,17 +206,27 @@ public:
 
 	std::string triggerChars() override;
 
-	bool canHandle(Parser * lex) override;
+	bool canHandle(Parser * lex) override {
+		return canHandleBlock(lex) ||
+			((lex->lastToken == tokNumber) &&
+			(lex->lastString.back() == '.') &&
+			(lex->peektok() == tokSpace || lex->peektok() == tokNewline));
+	}
 
 	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
 };
 
 class CodeHandler : public ParserHandler {
 protected:
 	
-	std::vector<std::unique_ptr<_ASTInlineElement>> content;
+	// Lines read so far, separated by '\n'. Only filled line by line inside containers,
+	// otherwise the whole text is read at once
+	std::string body;
+	bool hasBody = false;
 	int fenceCount = 0;
 	std::string lang;
 	std::unique_ptr<ASTInlineText> firstLine;
@@ -166,9 +239,91 @@ public:
 
 	std::string triggerChars() override;
 
+	bool canHandle(Parser * lex) override {
+		if (fenceCount != 0)
+			return true;
+		return 
+			(firstSym(lex) == '`') &&
+			(lex->lastInt >= 3);
+	}
+
+	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
+
+	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
+};
+
+/*
+	Pipe tables, one row per line:
+	| first cell | second cell
+	| :-- | :--:
+	Cells are split off the raw line, those without any markup keep their text as a span
+	of the input and are never tokenized. A second row of alignments makes the first one the header
+*/
+class TableHandler : public ParserHandler {
+protected:
+
+	std::unique_ptr<ASTTable> table;
+
+	// Rows read so far, including the alignment row
+	size_t rows = 0;
+
+	// Reads the cell the Parser is on and consumes the '|' after it
+	std::unique_ptr<ASTTableCell> parseCell(Parser * lex, std::string_view line);
+
+public:
+
+	TableHandler() {}
+
+	std::unique_ptr<ParserHandler> createNew() override;
+
+	std::string triggerChars() override;
+
+	bool canHandle(Parser * lex) override {
+		return 
+			(lex->lastToken == tokSym) && 
+			(lex->lastString[0] == '|');
+	}
+
+	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
+
+	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
+
+	bool reset() override;
+};
+
+/*
+	Definitions for references, one per line:
+	%(name): url command
+	%{name}: command
+	%<name>: text
+	^id: text
+	Text can go on in lines indented by two or more spaces. Nothing is inserted into the document,
+	the definition fills in the Reference its uses point to, no matter whether they come before or after it
+*/
+class ReferenceHandler : public ParserHandler {
+protected:
+
+	// Definition whose text may continue on the next line
+	Reference * open = nullptr;
+
+	// Takes repeated definitions, only the first one of a name counts
+	Reference unused;
+
+public:
+
+	ReferenceHandler() {}
+
+	std::unique_ptr<ParserHandler> createNew() override;
+
+	std::string triggerChars() override;
+
 	bool canHandle(Parser * lex) override;
 
 	std::tuple<std::unique_ptr<_ASTElement>, bool> handle(Parser * lex) override;
 
 	std::unique_ptr<_ASTElement> finish(Parser * lex) override;
-};
\ No newline at end of file
+
+	bool reset() override;
+};
@@ -0,0 +1,269 @@
+#include "scanner.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+CharClassTable::CharClassTable() {
+	for (auto & c : cls)
+		c = clsText;
+	for (auto & m : lowMask)
+		m = 0;
+	for (int i = 0; i < 32; i++)
+		highMask[i] = (i % 16) < 8 ? 1 << (i % 16) : 0;
+
+	for (int c = '0'; c <= '9'; c++)
+		set(c, clsDigit);
+	set(' ', clsSpace);
+	set('\n', clsNewline);
+	set('\\', clsEscape);
+}
+
+void CharClassTable::set(unsigned char chr, CharClass c) {
+	cls[chr] = c;
+	if (c == clsText)
+		return; // Marks are never removed, a stale one only costs a scalar recheck
+
+	if (chr >= 0x80) {
+		highSpecial = true;
+		return;
+	}
+	// Both 16 byte lanes hold the same table for the 32 byte kernel
+	lowMask[chr & 0x0F] |= 1 << (chr >> 4);
+	lowMask[16 + (chr & 0x0F)] |= 1 << (chr >> 4);
+}
+
+// ----- Scalar kernels ----- \\ 
+
+static const char * scanTextScalar(const char * p, const char * end, const CharClassTable & table) {
+	while (p != end && table.cls[(unsigned char) *p] == clsText)
+		p++;
+	return p;
+}
+
+static const char * scanRunScalar(const char * p, const char * end, char chr) {
+	while (p != end && *p == chr)
+		p++;
+	return p;
+}
+
+static const char * scanAsciiScalar(const char * p, const char * end) {
+	while (p != end && (unsigned char) *p < 0x80)
+		p++;
+	return p;
+}
+
+// What every ASCII char becomes in an id, 0 if it is dropped
+struct SlugTable {
+	char map[128];
+
+	SlugTable() {
+		for (int c = 0; c < 128; c++) {
+			if ('A' <= c && c <= 'Z')
+				map[c] = c + 32;
+			else if (('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || c == '_' || c == '-')
+				map[c] = c;
+			else if (c == ' ')
+				map[c] = '-';
+			else
+				map[c] = 0;
+		}
+	}
+};
+
+static const SlugTable slugTable;
+
+static const char * slugAsciiScalar(const char * p, const char * end, char * & out) {
+	while (p != end && (unsigned char) *p < 0x80) {
+		char c = slugTable.map[(unsigned char) *p++];
+		if (c != 0)
+			*out++ = c;
+	}
+	return p;
+}
+
+#ifdef SCANNER_X86
+
+// ----- SSE kernels ----- \\ 
+
+__attribute__((target("sse2")))
+static const char * scanAsciiSSE2(const char * p, const char * end) {
+	while (end - p >= 16) {
+		unsigned high = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) p));
+		if (high != 0)
+			return p + __builtin_ctz(high);
+		p += 16;
+	}
+	return scanAsciiScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char * scanRunSSE2(const char * p, const char * end, char chr) {
+	const __m128i c = _mm_set1_epi8(chr);
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		unsigned other = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, c)) & 0xFFFF;
+		if (other != 0)
+			return p + __builtin_ctz(other);
+		p += 16;
+	}
+	return scanRunScalar(p, end, chr);
+}
+
+__attribute__((target("ssse3")))
+static const char * scanTextSSSE3(const char * p, const char * end, const CharClassTable & table) {
+	const __m128i low = _mm_load_si128((const __m128i *) table.lowMask);
+	const __m128i high = _mm_load_si128((const __m128i *) table.highMask);
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	const __m128i zero = _mm_setzero_si128();
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		__m128i l = _mm_shuffle_epi8(low, _mm_and_si128(v, nibble));
+		__m128i h = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		unsigned special = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), zero)) & 0xFFFF;
+		if (special != 0)
+			return scanTextScalar(p + __builtin_ctz(special), end, table);
+		p += 16;
+	}
+	return scanTextScalar(p, end, table);
+}
+
+__attribute__((target("sse2")))
+static const char * slugAsciiSSE2(const char * p, const char * end, char * & out) {
+	const __m128i upperFirst = _mm_set1_epi8('A' - 1), upperLast = _mm_set1_epi8('Z' + 1);
+	const __m128i lowerFirst = _mm_set1_epi8('a' - 1), lowerLast = _mm_set1_epi8('z' + 1);
+	const __m128i digitFirst = _mm_set1_epi8('0' - 1), digitLast = _mm_set1_epi8('9' + 1);
+	const __m128i caseBit = _mm_set1_epi8(0x20), space = _mm_set1_epi8(' ');
+	const __m128i dash = _mm_set1_epi8('-'), underscore = _mm_set1_epi8('_');
+	alignas(16) char block[16];
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		if (_mm_movemask_epi8(v) != 0)
+			break; // Non-ASCII, the scalar loop stops in front of it
+
+		// Bytes >= 0x80 are excluded above, so signed compares work
+		__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, upperFirst), _mm_cmplt_epi8(v, upperLast));
+		__m128i isSpace = _mm_cmpeq_epi8(v, space);
+		v = _mm_or_si128(v, _mm_and_si128(upper, caseBit));
+		v = _mm_or_si128(_mm_andnot_si128(isSpace, v), _mm_and_si128(isSpace, dash));
+
+		__m128i keep = _mm_or_si128(
+			_mm_or_si128(
+				_mm_and_si128(_mm_cmpgt_epi8(v, lowerFirst), _mm_cmplt_epi8(v, lowerLast)),
+				_mm_and_si128(_mm_cmpgt_epi8(v, digitFirst), _mm_cmplt_epi8(v, digitLast))),
+			_mm_or_si128(_mm_cmpeq_epi8(v, dash), _mm_cmpeq_epi8(v, underscore)));
+		unsigned mask = _mm_movemask_epi8(keep);
+
+		if (mask == 0xFFFF) {
+			_mm_storeu_si128((__m128i *) out, v);
+			out += 16;
+		}
+		else {
+			_mm_store_si128((__m128i *) block, v);
+			for (; mask != 0; mask &= mask - 1)
+				*out++ = block[__builtin_ctz(mask)];
+		}
+		p += 16;
+	}
+	return slugAsciiScalar(p, end, out);
+}
+
+// ----- AVX2 kernels ----- \\ 
+
+__attribute__((target("avx2")))
+static const char * scanAsciiAVX2(const char * p, const char * end) {
+	while (end - p >= 32) {
+		unsigned high = (unsigned) _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) p));
+		if (high != 0)
+			return p + __builtin_ctz(high);
+		p += 32;
+	}
+	return scanAsciiSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char * scanRunAVX2(const char * p, const char * end, char chr) {
+	const __m256i c = _mm256_set1_epi8(chr);
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) p);
+		unsigned other = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, c));
+		if (other != 0)
+			return p + __builtin_ctz(other);
+		p += 32;
+	}
+	return scanRunSSE2(p, end, chr);
+}
+
+__attribute__((target("avx2")))
+static const char * scanTextAVX2(const char * p, const char * end, const CharClassTable & table) {
+	const __m256i low = _mm256_load_si256((const __m256i *) table.lowMask);
+	const __m256i high = _mm256_load_si256((const __m256i *) table.highMask);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	const __m256i zero = _mm256_setzero_si256();
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) p);
+		__m256i l = _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble));
+		__m256i h = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+		unsigned special = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero));
+		if (special != 0)
+			return scanTextScalar(p + __builtin_ctz(special), end, table);
+		p += 32;
+	}
+	return scanTextSSSE3(p, end, table);
+}
+
+#endif
+
+// ----- Dispatch ----- \\ 
+
+typedef const char * (*TextKernel)(const char *, const char *, const CharClassTable &);
+typedef const char * (*RunKernel)(const char *, const char *, char);
+typedef const char * (*AsciiKernel)(const char *, const char *);
+typedef const char * (*SlugKernel)(const char *, const char *, char * &);
+
+struct ScanKernels {
+	TextKernel text;
+	RunKernel run;
+	AsciiKernel ascii;
+	SlugKernel slug;
+	const char * name;
+};
+
+static ScanKernels pickKernels() {
+#ifdef SCANNER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return { scanTextAVX2, scanRunAVX2, scanAsciiAVX2, slugAsciiSSE2, "avx2" };
+	if (__builtin_cpu_supports("ssse3"))
+		return { scanTextSSSE3, scanRunSSE2, scanAsciiSSE2, slugAsciiSSE2, "ssse3" };
+	if (__builtin_cpu_supports("sse2"))
+		return { scanTextScalar, scanRunSSE2, scanAsciiSSE2, slugAsciiSSE2, "sse2" };
+#endif
+	return { scanTextScalar, scanRunScalar, scanAsciiScalar, slugAsciiScalar, "scalar" };
+}
+
+static const ScanKernels kernels = pickKernels();
+
+const char * scanText(const char * begin, const char * end, const CharClassTable & table) {
+	if (!table.vectorizable())
+		return scanTextScalar(begin, end, table);
+	return kernels.text(begin, end, table);
+}
+
+const char * scanRun(const char * begin, const char * end, char chr) {
+	return kernels.run(begin, end, chr);
+}
+
+const char * scanAscii(const char * begin, const char * end) {
+	return kernels.ascii(begin, end);
+}
+
+const char * slugAscii(const char * begin, const char * end, char * & out) {
+	return kernels.slug(begin, end, out);
+}
+
+const char * scanKernelName() {
+	return kernels.name;
+}
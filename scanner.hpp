@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+
+enum CharClass : unsigned char {
+	clsText = 0,
+	clsDigit,
+	clsSpace,
+	clsNewline,
+	clsSym,
+	clsEscape, // Backslash, see escapeLength()
+};
+
+/*
+	Maps every byte to its CharClass. Also keeps the non-text bytes as
+	nibble masks, so runs of text can be found 16/32 bytes at a time
+*/
+class CharClassTable {
+protected:
+
+	// Bytes >= 0x80 marked as non-text, vector kernels can not be used
+	bool highSpecial = false;
+
+public:
+
+	CharClass cls[256];
+
+	// Bit (1 << high nibble) is set in lowMask[low nibble] for every non-text ASCII byte
+	alignas(32) unsigned char lowMask[32];
+	alignas(32) unsigned char highMask[32];
+
+	CharClassTable();
+
+	void set(unsigned char chr, CharClass c);
+
+	CharClass operator[](int chr) const {
+		return cls[(unsigned char) chr];
+	}
+
+	bool vectorizable() const {
+		return !highSpecial;
+	}
+};
+
+/*
+	@param table Class table, decides what is text
+	@return First char in [begin, end) that is not clsText, end if there is none
+*/
+const char * scanText(const char * begin, const char * end, const CharClassTable & table);
+
+/*
+	@param chr Char the run consists of
+	@return First char in [begin, end) that is not chr, end if there is none
+*/
+const char * scanRun(const char * begin, const char * end, char chr);
+
+/*
+	@return First byte in [begin, end) that is not ASCII (>= 0x80), end if there is none
+*/
+const char * scanAscii(const char * begin, const char * end);
+
+/*
+	Turns ASCII into an id as Parser::make_id() does: letters lowercased, digits, '_' and '-' kept,
+	space becomes '-', everything else is dropped. Stops on the first byte >= 0x80
+	@param out Where to write, moved past what was written. Needs room for end - begin chars
+	@return First byte in [begin, end) that is not ASCII, end if there is none
+*/
+const char * slugAscii(const char * begin, const char * end, char * & out);
+
+/*
+	Name of the kernel picked for this CPU ("avx2", "ssse3", "sse2" or "scalar")
+*/
+const char * scanKernelName();
@@ -0,0 +1,183 @@
+#define _FILE_OFFSET_BITS 64
+
+#include "source.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SOURCE_HAS_MMAP 1
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#define read _read
+#define close _close
+#define STDIN_FILENO 0
+#endif
+
+std::unique_ptr<Source> Source::open(const std::string & filename) {
+	if (filename == "-")
+		return std::make_unique<ChunkedSource>(STDIN_FILENO);
+
+	std::unique_ptr<MappedSource> mapped = std::make_unique<MappedSource>(filename);
+	if (mapped->isMapped())
+		return mapped;
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw "File not found";
+	return std::make_unique<ChunkedSource>(fd, true);
+}
+
+void Source::setPolicy(Utf8Policy policy) {
+	this->policy = policy;
+	if (policy == Utf8Policy::pass || utf8Validate(_data, _size) == _size)
+		return;
+
+	if (policy == Utf8Policy::reject)
+		throw "Invalid UTF-8";
+	_replaced = utf8Repair(_data, _size);
+	_data = _replaced.data();
+	_size = _replaced.size();
+}
+
+// ----- MappedSource ----- \\ 
+
+MappedSource::MappedSource(const std::string & filename) {
+#ifdef SOURCE_HAS_MMAP
+	// Check before opening, opening a FIFO would already consume its writer
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0 || !S_ISREG(info.st_mode) ||
+		(std::uint64_t) info.st_size > SIZE_MAX)
+		return; // Pipes, devices etc. are left to ChunkedSource
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0 || fstat(fd, &info) != 0) {
+		if (fd >= 0)
+			::close(fd);
+		return;
+	}
+
+	if (info.st_size == 0) {
+		// mmap() refuses empty mappings
+		::close(fd);
+		_data = "";
+		_mapped = true;
+		return;
+	}
+
+	size_t length = (size_t) info.st_size;
+	void * map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // Mapping stays valid
+	if (map == MAP_FAILED)
+		return;
+
+	// Lexer reads front to back, let the kernel read ahead aggressively
+	madvise(map, length, MADV_SEQUENTIAL);
+
+	_map = map;
+	_mapSize = length;
+	_data = (const char *) map;
+	_size = length;
+	_mapped = true;
+#endif
+}
+
+MappedSource::~MappedSource() {
+#ifdef SOURCE_HAS_MMAP
+	if (_map != nullptr)
+		munmap(_map, _mapSize);
+#endif
+}
+
+// ----- ChunkedSource ----- \\ 
+
+ChunkedSource::ChunkedSource(int fd, bool ownsFd) : fd(fd), ownsFd(ownsFd) {
+	capacity = chunkSize;
+	buffer = std::make_unique<char[]>(capacity);
+	_data = buffer.get();
+}
+
+ChunkedSource::~ChunkedSource() {
+	if (ownsFd)
+		::close(fd);
+}
+
+void ChunkedSource::setPolicy(Utf8Policy policy) {
+	// Nothing is exposed before it was checked, so only future reads are affected
+	this->policy = policy;
+}
+
+void ChunkedSource::reserve(size_t size) {
+	if (size <= capacity)
+		return;
+	size_t grown = std::max(capacity * 2, size);
+	std::unique_ptr<char[]> next = std::make_unique<char[]>(grown);
+	std::memcpy(next.get(), buffer.get(), _filled);
+	buffer = std::move(next);
+	capacity = grown;
+	_data = buffer.get();
+}
+
+void ChunkedSource::check() {
+	if (policy == Utf8Policy::pass) {
+		_size = _filled;
+		return;
+	}
+
+	// A sequence cut off by the end of this read may be completed by the next one
+	size_t limit = _filled;
+	if (!eof)
+		limit -= utf8Incomplete(buffer.get() + _size, _filled - _size);
+
+	if (utf8Validate(buffer.get() + _size, limit - _size) != limit - _size) {
+		if (policy == Utf8Policy::reject)
+			throw "Invalid UTF-8";
+
+		std::string fixed = utf8Repair(buffer.get() + _size, limit - _size);
+		size_t tail = _filled - limit;
+		reserve(_size + fixed.size() + tail);
+		std::memmove(buffer.get() + _size + fixed.size(), buffer.get() + limit, tail);
+		std::memcpy(buffer.get() + _size, fixed.data(), fixed.size());
+		limit = _size + fixed.size();
+		_filled = limit + tail;
+	}
+	_size = limit;
+}
+
+bool ChunkedSource::fill(std::uint64_t keep) {
+	// Drop everything before keep, move the rest to the front
+	size_t drop = keep <= _base ? 0 : (size_t) std::min<std::uint64_t>(keep - _base, _size);
+	if (drop != 0) {
+		std::memmove(buffer.get(), buffer.get() + drop, _filled - drop);
+		_base += drop;
+		_size -= drop;
+		_filled -= drop;
+	}
+	size_t visible = _size;
+
+	while (!eof) {
+		// A token longer than the buffer grows it
+		if (capacity - _filled < chunkSize)
+			reserve(_filled + chunkSize);
+
+		long n;
+		do {
+			n = read(fd, buffer.get() + _filled, (unsigned) (capacity - _filled));
+		} while (n < 0 && errno == EINTR);
+
+		if (n <= 0)
+			eof = true;
+		else
+			_filled += n;
+
+		check();
+		if (_size > visible)
+			return true;
+	}
+	return false;
+}
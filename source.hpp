@@ -0,0 +1,155 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "utf8.hpp"
+
+/*
+	Read-only input for the Parser. The loaded part of the input is one
+	contiguous window [data(), data() + size()) starting at absolute offset base().
+	Sources that hold all input at once never move their window
+*/
+class Source {
+protected:
+
+	const char * _data = nullptr;
+	size_t _size = 0;
+	std::uint64_t _base = 0;
+
+	Utf8Policy policy = Utf8Policy::pass;
+
+	// Copy of the input with invalid UTF-8 replaced, only used if there was any
+	std::string _replaced;
+
+public:
+
+	// How far behind the current token the Parser can always rewind
+	static const size_t rewindWindow = 64 * 1024;
+
+	virtual ~Source() {}
+
+	const char * data() const {
+		return _data;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	std::uint64_t base() const {
+		return _base;
+	}
+
+	/*
+		Loads more input. Everything from absolute offset keep onwards stays loaded,
+		but the window may move in memory
+		@param keep Oldest offset still needed by the caller
+		@return Whether new input was added. false means end of input
+	*/
+	virtual bool fill(std::uint64_t /*keep*/) {
+		return false;
+	}
+
+	/*
+		@return Whether the window never moves, so views into it stay valid as long as the Source does
+	*/
+	virtual bool stable() const {
+		return true;
+	}
+
+	/*
+		Sets how invalid UTF-8 is handled and checks the input loaded so far.
+		Has to be called before anything is read from the window
+		@param policy What to do with invalid input. Utf8Policy::reject throws
+	*/
+	virtual void setPolicy(Utf8Policy policy);
+
+	/*
+		Opens filename for reading. Regular files are memory mapped, everything else
+		(pipes, devices, or if mapping fails) is read in chunks. "-" reads stdin
+		@param filename File to open
+		@result Source holding the file content. Throws if the file can not be opened
+	*/
+	static std::unique_ptr<Source> open(const std::string & filename);
+};
+
+/*
+	Regular file mapped read-only into memory. Uses 64-bit offsets, so files over 2 GB work
+*/
+class MappedSource : public Source {
+protected:
+
+	void * _map = nullptr;
+	size_t _mapSize = 0;
+	bool _mapped = false;
+
+public:
+
+	/*
+		@param filename File to map
+		Check isMapped() afterwards, nothing is thrown if mapping fails
+	*/
+	MappedSource(const std::string & filename);
+
+	~MappedSource();
+
+	bool isMapped() const {
+		return _mapped;
+	}
+};
+
+/*
+	Memory owned by the caller, used as-is without copying. Has to outlive the Parser
+*/
+class BufferSource : public Source {
+public:
+
+	BufferSource(const char * data, size_t size) {
+		_data = data;
+		_size = size;
+	}
+};
+
+/*
+	Reads a file descriptor in large chunks. Works on stdin, pipes, sockets and anything
+	else that can not seek. Only what the Parser can still rewind to is kept (see Parser::refill())
+*/
+class ChunkedSource : public Source {
+protected:
+
+	int fd;
+	bool ownsFd;
+	bool eof = false;
+
+	std::unique_ptr<char[]> buffer;
+	size_t capacity = 0;
+
+	// Bytes read into buffer. Only the checked part [0, _size) is exposed
+	size_t _filled = 0;
+
+	void reserve(size_t size);
+
+	// Applies policy to everything read but not yet exposed
+	void check();
+
+public:
+
+	static const size_t chunkSize = 256 * 1024;
+
+	/*
+		@param fd Descriptor to read from
+		@param ownsFd Whether to close fd on destruction
+	*/
+	ChunkedSource(int fd, bool ownsFd = false);
+
+	~ChunkedSource();
+
+	bool fill(std::uint64_t keep) override;
+
+	bool stable() const override {
+		return false;
+	}
+
+	void setPolicy(Utf8Policy policy) override;
+};
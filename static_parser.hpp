@@ -0,0 +1,168 @@
+#pragma once
+#include <tuple>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+#include "lexer.hpp"
+#include "parser_handler.hpp"
+#include "inline_handler.hpp"
+
+/*
+	Parser with a handler set fixed at compile time. Handlers are asked in the order of the
+	template arguments, block and inline handlers can be mixed. The last block handler is H_default.
+	canHandle() is called without a vtable so it can be inlined, and only for handlers whose
+	triggerChars() match the current token, the same ones the runtime dispatch table would ask.
+	Handlers added with addHandler() are still asked afterwards, e.g. for plugins
+*/
+template<class... Handlers>
+class StaticParser : public Parser {
+protected:
+
+	template<size_t I>
+	using HandlerAt = std::tuple_element_t<I, std::tuple<Handlers...>>;
+
+	template<class H>
+	static constexpr bool isBlock = std::is_base_of<ParserHandler, H>::value;
+
+	static constexpr size_t blockCount = (0 + ... + (isBlock<Handlers> ? 1 : 0));
+	static constexpr size_t inlineCount = sizeof...(Handlers) - blockCount;
+
+	static_assert(sizeof...(Handlers) <= 64, "StaticParser takes at most 64 handlers");
+
+	// Position of handler I in its handler list, same as the order it was added in
+	template<size_t I>
+	static constexpr size_t listIndex() {
+		constexpr bool block[] = { isBlock<Handlers>... };
+		size_t index = 0;
+		for (size_t i = 0; i < I; i++)
+			index += block[i] == block[I];
+		return index;
+	}
+
+	// Only used for canHandle(), handling is done by instances from the pool
+	std::tuple<Handlers...> prototypes;
+
+	// Bit I is set if handler I is asked for a tokSym starting with that char, see DispatchTable
+	std::array<std::uint64_t, 256> symMask{};
+	// Handlers asked for any other token, those without trigger chars
+	std::uint64_t otherMask = 0;
+
+	std::uint64_t candidates() const {
+		return lastToken == tokSym ? symMask[(unsigned char) lastString[0]] : otherMask;
+	}
+
+	template<size_t I>
+	bool tryBlock(std::unique_ptr<ParserHandler> & res, std::uint64_t mask) {
+		using H = HandlerAt<I>;
+		if constexpr (isBlock<H>) {
+			if ((mask >> I & 1) && std::get<I>(prototypes).H::canHandle(this)) {
+				res = acquireHandler(listIndex<I>());
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template<size_t I>
+	bool tryInline(std::unique_ptr<InlineHandler> & res, std::uint64_t mask) {
+		using H = HandlerAt<I>;
+		if constexpr (!isBlock<H>) {
+			if ((mask >> I & 1) && std::get<I>(prototypes).H::canHandle(this)) {
+				res = acquireInlineHandler(listIndex<I>());
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template<size_t... I>
+	std::unique_ptr<ParserHandler> findBlock(std::index_sequence<I...>) {
+		std::unique_ptr<ParserHandler> res;
+		std::uint64_t mask = candidates();
+		if ((tryBlock<I>(res, mask) || ...))
+			return res;
+		return findHandlerFrom(blockCount);
+	}
+
+	template<size_t... I>
+	std::unique_ptr<InlineHandler> findInline(std::index_sequence<I...>) {
+		std::unique_ptr<InlineHandler> res;
+		std::uint64_t mask = candidates();
+		if ((tryInline<I>(res, mask) || ...))
+			return res;
+		return findInlineHandlerFrom(inlineCount);
+	}
+
+	template<size_t... I>
+	void addHandlers(std::index_sequence<I...>) {
+		(addStatic<I>(), ...);
+	}
+
+	template<size_t I>
+	void addStatic() {
+		using H = HandlerAt<I>;
+		std::string name = (isBlock<H> ? "H_static" : "I_static") + std::to_string(I);
+
+		std::string triggers = std::get<I>(prototypes).triggerChars();
+		if (triggers.empty()) {
+			otherMask |= std::uint64_t(1) << I;
+			for (auto & e : symMask)
+				e |= std::uint64_t(1) << I;
+		}
+		for (auto e : triggers)
+			symMask[(unsigned char) e] |= std::uint64_t(1) << I;
+		if constexpr (isBlock<H>) {
+			addHandler<H>(name);
+			if (listIndex<I>() == blockCount - 1)
+				addHandlerAlias("H_default", name);
+		}
+		else
+			addInlineHandler<H>(name);
+	}
+
+public:
+
+	/*
+		Same arguments as Parser, all handlers are added right away
+	*/
+	template<class... Args>
+	StaticParser(Args&&... args) : Parser(std::forward<Args>(args)...) {
+		addHandlers(std::index_sequence_for<Handlers...>());
+	}
+
+	using Parser::findNextHandler;
+	using Parser::findNextInlineHandler;
+
+	std::unique_ptr<ParserHandler> findNextHandler() override {
+		return findBlock(std::index_sequence_for<Handlers...>());
+	}
+
+	std::unique_ptr<InlineHandler> findNextInlineHandler() override {
+		return findInline(std::index_sequence_for<Handlers...>());
+	}
+};
+
+/*
+	Handler set of addDefaultHandlers(), in the same order
+*/
+using DefaultParser = StaticParser<
+	UnorderedListHandler,
+	OrderedListHandler,
+	HeadingHandler,
+	BlockquoteHandler,
+	HLineHandler,
+	CodeHandler,
+	TableHandler,
+	ReferenceHandler,
+	InlineTemplateHandler<'*'>,
+	InlineTemplateHandler<'/'>,
+	InlineTemplateHandler<'_'>,
+	InlineTemplateHandler<'~'>,
+	InlineTemplateHandler<'='>,
+	InlineSmileyHandler,
+	InlineCodeHandler,
+	InlineModifierHandler,
+	ParagraphHandler
+>;
@@ -0,0 +1,81 @@
+#include "token.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+
+Lexeme TokenBuffer::at(size_t i) const {
+	Lexeme l;
+	l.kind = (Token) kinds[i];
+	l.offset = offsets[i];
+	l.length = lengths[i];
+	l.count = (l.kind == tokSpace || l.kind == tokSym) ? counts[i] : 1;
+	l.number = l.kind == tokNumber ? counts[i] : 0;
+	return l;
+}
+
+void TokenBuffer::tokenize(const char * data, size_t size, std::uint64_t base, const CharClassTable & table) {
+	kinds.clear();
+	offsets.clear();
+	lengths.clear();
+	counts.clear();
+
+	// Prose has well over 3 chars per token, avoids most regrowing
+	size_t expected = size / 3 + 1;
+	kinds.reserve(expected);
+	offsets.reserve(expected);
+	lengths.reserve(expected);
+	counts.reserve(expected);
+
+	const char * p = data;
+	const char * end = data + size;
+
+	// Same as Parser::gettok(): a NUL where a token starts is skipped once
+	if (p != end && *p == 0)
+		p++;
+
+	while (p != end) {
+		const char * start = p;
+		Token kind;
+		long long count = 1;
+
+		switch (table[*p]) {
+		case clsText:
+			kind = tokText;
+			p = scanText(p + 1, end, table);
+			if ((std::uint64_t) (p - start) > UINT32_MAX)
+				p = start + UINT32_MAX; // Continues as another text token
+			break;
+		case clsDigit:
+			kind = tokNumber;
+			count = *p++ - '0';
+			while (p != end && '0' <= *p && *p <= '9')
+				count = std::min(count * 10 + (*p++ - '0'), (long long) INT_MAX);
+			if (p != end && *p == '.')
+				p++;
+			break;
+		case clsEscape:
+			kind = tokText;
+			p += escapeLength(p + 1 != end ? (unsigned char) p[1] : EOF);
+			break;
+		case clsSpace:
+		case clsSym:
+			kind = table[*p] == clsSpace ? tokSpace : tokSym;
+			p = scanRun(p + 1, end, *start);
+			count = p - start;
+			break;
+		default:
+			kind = tokNewline;
+			p++;
+			break;
+		}
+
+		kinds.push_back((signed char) kind);
+		offsets.push_back(base + (start - data));
+		lengths.push_back((std::uint32_t) (p - start));
+		counts.push_back((std::int32_t) count);
+
+		if (p != end && *p == 0)
+			p++;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+#include "scanner.hpp"
+
+enum Token : int {
+	
+	tokEOF = -1, // End of File
+	tokText = -2, // lastString contains text
+	tokNumber = -3, // lastInt contains number, lastString contains string read (reads <Number>.)
+	tokSpace = -4, // lastString contains ' ', lastInt contains amount of spaces
+	tokNewline = -5, // Newline Character read (\n)
+	tokSym = -6, // Indicates formatting Symbol, lastString contains it, lastInt contains amount
+};
+
+/*
+	Escape sequences are a backslash followed by ASCII punctuation or 'n'. They are lexed
+	as tokText of their own, a backslash before anything else is a tokText of length 1
+	@param next Char after the backslash, EOF if there is none
+	@return Length of the escape sequence in the source, 2 if it is valid otherwise 1
+*/
+inline size_t escapeLength(int next) {
+	return (next == 'n' || (33 <= next && next <= 47) || (58 <= next && next <= 64) ||
+		(91 <= next && next <= 96) || (123 <= next && next <= 126)) ? 2 : 1;
+}
+
+/*
+	@param start Start of a tokText in the source
+	@param length Length of it in the source
+	@return What the token stands for. The escaped char for escape sequences, otherwise the span itself
+*/
+inline std::string_view tokenText(const char * start, size_t length) {
+	if (length != 2 || start[0] != '\\')
+		return std::string_view(start, length);
+	if (start[1] == 'n')
+		return std::string_view("\n", 1);
+	return std::string_view(start + 1, 1);
+}
+
+/*
+	Span of one token in the source, see Parser::lexeme()
+*/
+struct Lexeme {
+	Token kind;
+	std::uint64_t offset; // Source offset of the first char
+	size_t length; // Chars in source, a whole run for tokSpace/tokSym
+	int count; // Amount of chars in a tokSpace/tokSym run not consumed yet
+	int number; // Value of a tokNumber
+};
+
+/*
+	Whole input tokenized up front, stored as one array per field.
+	Lexes exactly like Parser::gettok(), see Parser::pretokenize()
+*/
+class TokenBuffer {
+public:
+
+	std::vector<signed char> kinds; // Token
+	std::vector<std::uint64_t> offsets; // Source offset of the first char
+	std::vector<std::uint32_t> lengths; // Chars in source
+	std::vector<std::int32_t> counts; // Run length for tokSpace/tokSym, value for tokNumber
+
+	size_t size() const {
+		return kinds.size();
+	}
+
+	Lexeme at(size_t i) const;
+
+	/*
+		Replaces the content with the tokens of [data, data + size)
+		@param base Source offset of data
+		@param table Decides which chars are symbols
+	*/
+	void tokenize(const char * data, size_t size, std::uint64_t base, const CharClassTable & table);
+};
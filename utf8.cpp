@@ -0,0 +1,89 @@
+#include "utf8.hpp"
+#include "scanner.hpp"
+
+/*
+	@return Length of the sequence at p, 0 if it is invalid, -1 if it is cut off by end
+*/
+static int sequenceLength(const unsigned char * p, const unsigned char * end) {
+	unsigned char c = p[0];
+	unsigned char low = 0x80;
+	unsigned char high = 0xBF;
+	int length;
+
+	if (c < 0x80)
+		return 1;
+	else if (0xC2 <= c && c <= 0xDF)
+		length = 2;
+	else if (0xE0 <= c && c <= 0xEF) {
+		length = 3;
+		if (c == 0xE0)
+			low = 0xA0; // Overlong
+		if (c == 0xED)
+			high = 0x9F; // Surrogates
+	}
+	else if (0xF0 <= c && c <= 0xF4) {
+		length = 4;
+		if (c == 0xF0)
+			low = 0x90; // Overlong
+		if (c == 0xF4)
+			high = 0x8F; // Above U+10FFFF
+	}
+	else
+		return 0;
+
+	for (int i = 1; i < length; i++) {
+		if (p + i == end)
+			return -1;
+		if (p[i] < low || p[i] > high)
+			return 0;
+		low = 0x80;
+		high = 0xBF;
+	}
+	return length;
+}
+
+size_t utf8Validate(const char * data, size_t size) {
+	const char * p = data;
+	const char * end = data + size;
+
+	while ((p = scanAscii(p, end)) != end) {
+		// Decode until the text is back to ASCII
+		do {
+			int length = sequenceLength((const unsigned char *) p, (const unsigned char *) end);
+			if (length <= 0)
+				return p - data;
+			p += length;
+		} while (p != end && (unsigned char) *p >= 0x80);
+	}
+	return size;
+}
+
+std::string utf8Repair(const char * data, size_t size) {
+	std::string res;
+	res.reserve(size + size / 8);
+
+	const char * p = data;
+	const char * end = data + size;
+	while (p != end) {
+		const char * valid = p + utf8Validate(p, end - p);
+		res.append(p, valid);
+		if (valid == end)
+			break;
+		res += "\xEF\xBF\xBD";
+		p = valid + 1;
+	}
+	return res;
+}
+
+size_t utf8Incomplete(const char * data, size_t size) {
+	const unsigned char * end = (const unsigned char *) data + size;
+	for (size_t back = 1; back <= 3 && back <= size; back++) {
+		const unsigned char * p = end - back;
+		if (*p < 0x80)
+			return 0;
+		if (*p >= 0xC0)
+			return sequenceLength(p, end) == -1 ? back : 0;
+		// Continuation byte, lead is further back
+	}
+	return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+/*
+	What a Source does with input that is not valid UTF-8.
+	Scoped, so it never converts to the size of Parser(const char *, size_t)
+*/
+enum class Utf8Policy {
+	pass, // Used as-is, nothing is checked
+	reject, // Throws
+	replace, // Every invalid byte becomes U+FFFD
+};
+
+/*
+	Checks data for valid UTF-8. Runs of ASCII are skipped 16/32 bytes at a time,
+	only multibyte sequences are decoded
+	@return Offset of the first invalid byte, size if everything is valid.
+	A sequence cut off by the end of data is invalid
+*/
+size_t utf8Validate(const char * data, size_t size);
+
+/*
+	@return Copy of data with every byte that is not part of a valid sequence replaced by U+FFFD
+*/
+std::string utf8Repair(const char * data, size_t size);
+
+/*
+	@return Amount of bytes at the end of data that start a sequence, which may be completed by more input
+*/
+size_t utf8Incomplete(const char * data, size_t size);